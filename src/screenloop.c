@@ -57,6 +57,10 @@ typedef struct {
     pthread_mutex_t update_mutex;
     pthread_cond_t  update_cond;
     struct timeval  update_job_now;
+    /* contiguous snapshot of sensor_watch_list_get(), rebuilt on compute,
+     * replaced or emptied only under update_mutex + SENSOR_LOCK_WRITE */
+    sensor_sample_t ** watchs;
+    unsigned int    watchs_nb;
     /* timers */
     unsigned int    timer_ms;
     unsigned int    sensors_timer_ms;
@@ -210,6 +214,56 @@ static void vsensors_watch_priv_free(void * vdata) {
     }
 }
 
+/* ************************************************************************ */
+/** rebuild the contiguous watch array from sensor watch list (sctx not locked,
+ * update_mutex held or update job not started).
+ * The display and update loops walk this array instead of chasing list pointers
+ * each frame. The new array is built aside under the read lock, and swapped in
+ * under the write lock only if the watch set changed: the update job, which
+ * walks it under its own read lock, never sees a freed array. */
+static int vsensors_watchs_snapshot(vsensors_display_data_t * data) {
+    const slist_t *     watchs;
+    sensor_sample_t **  new_watchs = NULL;
+    sensor_sample_t **  old_watchs;
+    unsigned int        nb = 0, size = 0;
+    int                 ret = 0;
+
+    sensor_lock(data->sctx, SENSOR_LOCK_READ);
+    watchs = sensor_watch_list_get(data->sctx);
+    SLISTC_FOREACH_ELT(watchs, list) {
+        if (nb >= size) {
+            sensor_sample_t **  tmp;
+            size = size == 0 ? 64 : size * 2;
+            if ((tmp = realloc(new_watchs, size * sizeof(*new_watchs))) == NULL) {
+                ret = -1;
+                break ;
+            }
+            new_watchs = tmp;
+        }
+        new_watchs[nb++] = (sensor_sample_t *) list->data;
+    }
+    sensor_unlock(data->sctx);
+
+    /* data->watchs is only replaced by this thread: no lock needed to compare */
+    if (ret == 0 && nb == data->watchs_nb
+    &&  (nb == 0 || memcmp(new_watchs, data->watchs, nb * sizeof(*new_watchs)) == 0)) {
+        free(new_watchs);
+        return 0;
+    }
+    if (ret != 0) {
+        free(new_watchs);
+        new_watchs = NULL;
+        nb = 0;
+    }
+    sensor_lock(data->sctx, SENSOR_LOCK_WRITE);
+    old_watchs = data->watchs;
+    data->watchs = new_watchs;
+    data->watchs_nb = nb;
+    sensor_unlock(data->sctx);
+    free(old_watchs);
+    return ret;
+}
+
 /* ************************************************************************ */
 /** compute placement of each sensor */
 static int vsensors_display_compute(
@@ -228,7 +282,6 @@ static int vsensors_display_compute(
     slist_t *                   lsb;
     unsigned int                i_st;
     sensor_sample_t *           prev;
-    const slist_t *             watchs = NULL;
     unsigned long               timer_pgcd;
     double                      timer_precision = 10000.0L;
     const double                timer_min_precision = 50.0L;
@@ -313,16 +366,20 @@ static int vsensors_display_compute(
     nb_per_col = data->end_row - data->start_row + 1;
 
     /* get number of watchs and maximum size of a watch label */
+    if (vsensors_watchs_snapshot(data) != 0) {
+        LOG_ERROR(data->log, "%s(): cannot allocate watch array: %s", __func__, strerror(errno));
+        return -1;
+    }
     sensor_lock(data->sctx, SENSOR_LOCK_READ);
-    watchs = sensor_watch_list_get(data->sctx);
     maxlen = 0;
-    watchs_nb = 0;
+    watchs_nb = data->watchs_nb;
+    LOG_DEBUG(data->log, "%s(): %zu watchs", __func__, watchs_nb);
 
-    SLISTC_FOREACH_DATA(watchs, watch, sensor_sample_t *) {
+    for (i = 0; i < watchs_nb; ++i) {
+        const sensor_sample_t * watch = data->watchs[i];
         unsigned int sz = strlen(vsensors_fam_name(watch)) + 1 + strlen(vsensors_label(watch));
         if (sz > maxlen)
             maxlen = sz;
-        ++watchs_nb;
     }
 
     /* compute nb_col_per_page and col_size */
@@ -371,8 +428,8 @@ static int vsensors_display_compute(
     statusbar_step = -1;
     last_statusbar_sepptr = NULL;
 
-    SLISTC_FOREACH_ELT(watchs, list) {
-        sensor_sample_t * watch = (sensor_sample_t *) list->data;
+    for (unsigned int i_watch = 0; i_watch < watchs_nb; ++i_watch) {
+        sensor_sample_t * watch = data->watchs[i_watch];
 
         /** allocate sensor user private data, or free previous label */
         if (watch->user_data != NULL) {
@@ -385,7 +442,7 @@ static int vsensors_display_compute(
             break ;
         }
         /* keep prev/next */
-        watch_data.next = list->next != NULL ? (sensor_sample_t *) list->next->data : NULL;
+        watch_data.next = i_watch + 1 < watchs_nb ? data->watchs[i_watch + 1] : NULL;
         watch_data.prev = prev;
         prev = watch;
         /* other watch_data init */
@@ -873,7 +930,8 @@ static inline int vsensors_is_displayed(vsensors_display_data_t * data,
 /* ************************************************************************ */
 static void vsensors_draw_specials(vsensors_display_data_t * data) {
     sensor_lock(data->sctx, SENSOR_LOCK_READ);
-    SLISTC_FOREACH_DATA(sensor_watch_list_get(data->sctx), sensor, sensor_sample_t *) {
+    for (unsigned int i = 0; i < data->watchs_nb; ++i) {
+        sensor_sample_t * sensor = data->watchs[i];
         if (sensor->user_data != NULL) {
             vsensors_watch_display_t * wdata = (vsensors_watch_display_t *) (sensor->user_data);
             if (wdata->next_display != NULL || sensor == data->wselected) {
@@ -945,7 +1003,8 @@ static void * vsensors_update_job(void * vdata) {
         /* do updates */
         ret = 0;
         sensor_lock(data->sctx, SENSOR_LOCK_READ);
-        SLISTC_FOREACH_DATA(sensor_watch_list_get(data->sctx), sensor, sensor_sample_t *) {
+        for (unsigned int i = 0; i < data->watchs_nb; ++i) {
+            sensor_sample_t * sensor = data->watchs[i];
             if (vsensors_is_displayed(data, sensor)) {
                 if ((update_ret = sensor_update_check(sensor, &now)) == SENSOR_UPDATED) {
                     ++ret;
@@ -1129,8 +1188,8 @@ static unsigned int vsensors_display(
                         vsensors_select_sensor(data, -1, VSH_ABSOLUTE);
                         data->wselected = NULL;
                     }
-                    SLISTC_FOREACH_DATA(sensor_watch_list_get(data->sctx),
-                                        sensor, sensor_sample_t *) {
+                    for (unsigned int i = 0; i < data->watchs_nb; ++i) {
+                        sensor_sample_t * sensor = data->watchs[i];
                         if (vsensors_is_displayed(data, sensor)) {
                             if (data->wselected == NULL && vsensors_is_watched(data, sensor)) {
                                 data->wselected = sensor;
@@ -1451,6 +1510,10 @@ static unsigned int vsensors_display(
                     if (ret > 0) {
                         vsensors_please_wait(data);
                         data->wselected = NULL;
+                        /* the watch array must not be walked until next compute */
+                        sensor_lock(data->sctx, SENSOR_LOCK_WRITE);
+                        data->watchs_nb = 0;
+                        sensor_unlock(data->sctx);
                         sensor_watch_del(data->sctx, buf,
                                 *key == 'D' ? SSF_DEFAULT & ~SSF_CASEFOLD
                                             : SSF_DEFAULT | SSF_CASEFOLD);
@@ -1588,6 +1651,8 @@ int vsensors_screen_loop(
         vsensors_watch_priv_free(watch);
     }
     sensor_unlock(data.sctx);
+    if (data.watchs != NULL)
+        free(data.watchs);
 
     if (data.scolor_header != NULL)
         free(data.scolor_header);
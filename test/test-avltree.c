@@ -29,6 +29,11 @@
 extern int ___nothing___; /* empty */
 #else
 #include <stdlib.h>
+#include <stdio.h>
+#include <stddef.h>
+#include <string.h>
+#include <pthread.h>
+#include <sched.h>
 
 #define VLIB_AVLTREE_NODE_TESTS 1 // for avltree_node_set() test functions
 #include "vlib/avltree.h"
@@ -621,8 +626,9 @@ static unsigned int avltree_test_visit(avltree_t * tree, int check_balance,
     /* memorysize */
     value = avltree_memorysize(tree);
     if (out)
-        LOG_INFO(log, "MEMORYSIZE = %ld (%.03fMB)",
-                 value, value / 1000.0 / 1000.0);
+        LOG_INFO(log, "MEMORYSIZE = %ld (%.03fMB, %.01f bytes/elt)",
+                 value, value / 1000.0 / 1000.0,
+                 avltree_count(tree) ? (double) value / avltree_count(tree) : 0.0);
     /* depth */
     if (check_balance) {
         errno = EBUSY; /* setting errno to check it is correctly set by avltree */
@@ -891,6 +897,2459 @@ static void * avltree_test_insert_job(void * vdata) {
     return (void *) ((long) ret);
 }
 
+/* ****************************************
+ * Loading a tree from sorted input
+ * ***************************************/
+typedef void * (*avltree_sorted_get_t)(const void * src, size_t i);
+
+static void * avltree_sorted_get_array(const void * src, size_t i) {
+    return ((void * const *) src)[i];
+}
+
+static void * avltree_sorted_get_rbuf(const void * src, size_t i) {
+    return rbuf_get((rbuf_t *) src, i);
+}
+
+static size_t avltree_test_load_sorted_level(avltree_t * tree, avltree_sorted_get_t get,
+                                             const void * src, size_t lo, size_t hi,
+                                             unsigned int depth) {
+    size_t mid;
+
+    if (lo >= hi)
+        return 0;
+    mid = lo + (hi - lo) / 2;
+    if (depth > 0) {
+        return avltree_test_load_sorted_level(tree, get, src, lo, mid, depth - 1)
+             + avltree_test_load_sorted_level(tree, get, src, mid + 1, hi, depth - 1);
+    }
+    void * data = get(src, mid);
+    if (avltree_insert(tree, data) != data || (data == NULL && errno != 0)) {
+        return 1;
+    }
+    return 0;
+}
+
+/* Links the midpoints of [lo, hi) on the depth levels under *nodeptr, without
+ * compare nor rotation. These levels are full, so the nodes are right with
+ * the 0 balance given by avltree_node_create(). */
+static size_t avltree_test_load_sorted_top(avltree_t * tree, avltree_node_t ** nodeptr,
+                                           avltree_sorted_get_t get, const void * src,
+                                           size_t lo, size_t hi, unsigned int depth) {
+    avltree_node_t *    node;
+    size_t              mid;
+
+    if (lo >= hi || depth == 0)
+        return 0;
+    mid = lo + (hi - lo) / 2;
+    if ((node = avltree_node_create(tree, get(src, mid), NULL, NULL)) == NULL)
+        return 1;
+    avltree_node_set(nodeptr, node);
+    ++tree->n_elements;
+    return avltree_test_load_sorted_top(tree, avltree_node_left_ptr(node), get, src,
+                                        lo, mid, depth - 1)
+         + avltree_test_load_sorted_top(tree, avltree_node_right_ptr(node), get, src,
+                                        mid + 1, hi, depth - 1);
+}
+
+/* Fills an empty tree with n sorted elements, as the balanced tree built on
+ * midpoints: its height - 1 first levels are full and linked directly in O(n).
+ * There is no balance setter, so the elements of the last, partial level go
+ * through avltree_insert(), which sets the balances of their ancestors: each
+ * insert ends on a leaf of a perfect tree, so no rotation is ever needed.
+ * This is O(n) when n is 2^height - 1, and O(n + k log n) with k elements on
+ * the last level. Returns the number of insert errors. */
+static size_t avltree_test_load_sorted(avltree_t * tree, avltree_sorted_get_t get,
+                                       const void * src, size_t n) {
+    size_t          nerrors;
+    unsigned int    height = 0;
+
+    for (size_t count = n; count > 0; count /= 2)
+        ++height;
+    if (height == 0)
+        return 0;
+    nerrors = avltree_test_load_sorted_top(tree, &(tree->root), get, src, 0, n, height - 1);
+    return nerrors + avltree_test_load_sorted_level(tree, get, src, 0, n, height - 1);
+}
+
+static size_t avltree_test_load_sorted_array(avltree_t * tree, void * const * array, size_t n) {
+    return avltree_test_load_sorted(tree, avltree_sorted_get_array, array, n);
+}
+
+static size_t avltree_test_load_sorted_rbuf(avltree_t * tree, rbuf_t * rbuf) {
+    return avltree_test_load_sorted(tree, avltree_sorted_get_rbuf, rbuf, rbuf_size(rbuf));
+}
+
+static size_t avltree_test_load_sorted_slist(avltree_t * tree, slist_t * list) {
+    size_t  n = slist_length(list), i = 0, nerrors;
+    void ** array;
+
+    if (n == 0)
+        return 0;
+    if ((array = malloc(n * sizeof(*array))) == NULL)
+        return n;
+    SLIST_FOREACH_DATA(list, data, void *) {
+        array[i++] = data;
+    }
+    nerrors = avltree_test_load_sorted_array(tree, array, n);
+    free(array);
+    return nerrors;
+}
+
+static unsigned int avltree_test_sorted_check(avltree_t * tree, size_t n, long step,
+                                              const char * name, log_t * log) {
+    unsigned int    nerrors = avlprint_rec_check_balance(tree->root, log);
+    size_t          height = 0;
+    long            prev = -1;
+
+    for (size_t count = n; count > 0; count /= 2)
+        ++height;
+    if (avltree_count(tree) != n || avlprint_rec_get_height(tree->root) != height) {
+        LOG_ERROR(log, "error: sorted tree(%s): count %zu (expected %zu), height %u "
+                       "(expected %zu)", name, avltree_count(tree), n,
+                  avlprint_rec_get_height(tree->root), height);
+        ++nerrors;
+    }
+    AVLTREE_FOREACH_DATA(tree, it_long, long, AVH_INFIX) {
+        if (it_long != prev + step) {
+            LOG_ERROR(log, "error: sorted tree(%s): got %ld after %ld", name, it_long, prev);
+            ++nerrors;
+            break ;
+        }
+        prev = it_long;
+    }
+    return nerrors;
+}
+
+static unsigned int avltree_test_sorted(const options_test_t * opts, log_t * log) {
+    const size_t    nb_elts[] = { 1000 * 1000, SIZE_MAX, 100 * 1000 * 1000, 0 };
+    const long      step = 2;
+    unsigned int    nerrors = 0;
+    void **         array;
+    avltree_t *     tree;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    for (const size_t * nb = nb_elts; *nb != 0; nb++) {
+        if (*nb == SIZE_MAX) { /* after size max this is only for TEST_bigtree */
+            if ((opts->test_mode & TEST_MASK(TEST_bigtree)) != 0) continue ; else break ;
+        }
+        LOG_INFO(log, "*************************************************");
+        LOG_INFO(log, "*** CREATING TREES FROM SORTED DATA (%zu elements)", *nb);
+
+        if ((array = malloc(*nb * sizeof(*array))) == NULL) {
+            LOG_ERROR(log, "error: cannot allocate sorted array(%zu)", *nb);
+            ++nerrors;
+            continue ;
+        }
+        for (size_t i = 0; i < *nb; ++i) {
+            array[i] = LG((long) (i + 1) * step - 1);
+        }
+
+        /* reference: one avltree_insert() per element, in ascending order */
+        if ((tree = avltree_create(AFL_DEFAULT, intcmp, NULL)) == NULL) {
+            LOG_ERROR(log, "error creating tree: %s", strerror(errno));
+            ++nerrors;
+        } else {
+            size_t n_fail = 0;
+            BENCHS_START(tm_bench, cpu_bench);
+            for (size_t i = 0; i < *nb; ++i) {
+                if (avltree_insert(tree, array[i]) != array[i])
+                    ++n_fail;
+            }
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log,
+                            "sorted insert: avltree_insert() x %zu | ", *nb);
+            if (n_fail != 0 || avltree_count(tree) != *nb) {
+                LOG_ERROR(log, "error: sorted insert: %zu errors, count %zu",
+                          n_fail, avltree_count(tree));
+                ++nerrors;
+            }
+            avltree_free(tree);
+        }
+
+        /* bulk load from array, then from rbuf and slist on the smallest size */
+        for (unsigned int i_src = 0; i_src < 3; ++i_src) {
+            const char *    name = i_src == 0 ? "array" : (i_src == 1 ? "rbuf" : "slist");
+            rbuf_t *        rbuf = NULL;
+            slist_t *       list = NULL;
+            size_t          n_fail;
+
+            if (i_src > 0 && nb != nb_elts)
+                break ;
+            if (i_src == 1 && (rbuf = rbuf_create(*nb, RBF_DEFAULT)) != NULL) {
+                for (size_t i = 0; i < *nb; ++i)
+                    rbuf_push(rbuf, array[i]);
+            } else if (i_src == 2) {
+                for (size_t i = *nb; i > 0; --i)
+                    list = slist_prepend(list, array[i - 1]);
+            }
+            if ((tree = avltree_create(AFL_DEFAULT, intcmp, NULL)) == NULL) {
+                LOG_ERROR(log, "error creating tree: %s", strerror(errno));
+                ++nerrors;
+            } else {
+                BENCHS_START(tm_bench, cpu_bench);
+                n_fail = i_src == 0 ? avltree_test_load_sorted_array(tree, array, *nb)
+                       : (i_src == 1 ? avltree_test_load_sorted_rbuf(tree, rbuf)
+                                     : avltree_test_load_sorted_slist(tree, list));
+                BENCHS_STOP_LOG(tm_bench, cpu_bench, log,
+                                "sorted insert: avltree_test_load_sorted(%s) x %zu | ", name, *nb);
+                if (n_fail != 0) {
+                    LOG_ERROR(log, "error: avltree_test_load_sorted(%s): %zu errors", name, n_fail);
+                    ++nerrors;
+                }
+                nerrors += avltree_test_sorted_check(tree, *nb, step, name, log);
+                avltree_free(tree);
+            }
+            if (rbuf != NULL)
+                rbuf_free(rbuf);
+            slist_free(list, NULL);
+        }
+        free(array);
+    }
+    return nerrors;
+}
+
+/* ****************************************
+ * Pooled nodes, compared with malloc
+ * ***************************************/
+/* Model of a per-tree node pool: fixed-size nodes are carved from slabs of
+ * AVLTREE_TEST_POOL_SLAB_NB nodes and recycled through a free list, so the
+ * tree teardown only frees the slabs. Nodes are 16-bytes aligned like malloc,
+ * keeping the low bits available as avltree does with optimize_bits. */
+#define AVLTREE_TEST_POOL_SLAB_NB   1024
+#define AVLTREE_TEST_POOL_ALIGN     16
+
+typedef struct {
+    size_t                  node_size;
+    void *                  free_list;
+    void *                  slabs;      /* list linked by the first word of each slab */
+    size_t                  n_slabs;
+    size_t                  n_used;     /* nodes carved from the current slab */
+} avltree_test_pool_t;
+
+static void avltree_test_pool_init(avltree_test_pool_t * pool, size_t node_size) {
+    if (node_size < sizeof(void *))
+        node_size = sizeof(void *);
+    pool->node_size = (node_size + AVLTREE_TEST_POOL_ALIGN - 1) & ~(AVLTREE_TEST_POOL_ALIGN - 1);
+    pool->free_list = pool->slabs = NULL;
+    pool->n_slabs = 0;
+    pool->n_used = AVLTREE_TEST_POOL_SLAB_NB;
+}
+
+static void * avltree_test_pool_alloc(avltree_test_pool_t * pool) {
+    void * node;
+
+    if ((node = pool->free_list) != NULL) {
+        pool->free_list = *((void **) node);
+        return node;
+    }
+    if (pool->n_used == AVLTREE_TEST_POOL_SLAB_NB) {
+        void * slab = malloc(AVLTREE_TEST_POOL_ALIGN
+                             + AVLTREE_TEST_POOL_SLAB_NB * pool->node_size);
+        if (slab == NULL)
+            return NULL;
+        *((void **) slab) = pool->slabs;
+        pool->slabs = slab;
+        ++pool->n_slabs;
+        pool->n_used = 0;
+    }
+    return (char *) pool->slabs + AVLTREE_TEST_POOL_ALIGN + pool->node_size * pool->n_used++;
+}
+
+static void avltree_test_pool_free(avltree_test_pool_t * pool, void * node) {
+    *((void **) node) = pool->free_list;
+    pool->free_list = node;
+}
+
+static void avltree_test_pool_destroy(avltree_test_pool_t * pool) {
+    for (void * slab = pool->slabs, * next; slab != NULL; slab = next) {
+        next = *((void **) slab);
+        free(slab);
+    }
+    pool->free_list = pool->slabs = NULL;
+    pool->n_slabs = 0;
+    pool->n_used = AVLTREE_TEST_POOL_SLAB_NB;
+}
+
+/* Replays the node allocations of a tree, without the tree: nb node creations,
+ * a free/allocate churn on half of them, then the teardown, with nodes of
+ * avltree's node size. Throughputs are allocator throughputs, not avltree ones. */
+static unsigned int avltree_test_node_pool(const options_test_t * opts, log_t * log) {
+    const size_t        nb_elts[] = { 1000 * 1000, SIZE_MAX, 10 * 1000 * 1000, 0 };
+    static const char * allocs[] = { "malloc", "pool" };
+    avltree_node_info_t node_infos;
+    unsigned int        nerrors = 0;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    avltree_node_infos(&node_infos);
+    for (const size_t * nb = nb_elts; *nb != 0; nb++) {
+        void **             nodes;
+
+        if (*nb == SIZE_MAX) { /* after size max this is only for TEST_bigtree */
+            if ((opts->test_mode & TEST_MASK(TEST_bigtree)) != 0) continue ; else break ;
+        }
+        LOG_INFO(log, "*************************************************");
+        LOG_INFO(log, "*** NODE ALLOCATIONS (%zu nodes of %zu bytes)", *nb, node_infos.node_size);
+        if ((nodes = malloc(*nb * sizeof(*nodes))) == NULL) {
+            LOG_ERROR(log, "error allocating node array: %s", strerror(errno));
+            ++nerrors;
+            continue ;
+        }
+        for (unsigned int i_alloc = 0; i_alloc < PTR_COUNT(allocs); ++i_alloc) {
+            avltree_test_pool_t pool;
+            size_t              n_alloc_errors = 0, sum = 0;
+
+            avltree_test_pool_init(&pool, node_infos.node_size);
+
+            BENCHS_START(tm_bench, cpu_bench);
+            for (size_t i = 0; i < *nb; ++i) {
+                if ((nodes[i] = i_alloc ? avltree_test_pool_alloc(&pool)
+                                        : malloc(node_infos.node_size)) == NULL) {
+                    ++n_alloc_errors;
+                    continue ;
+                }
+                memset(nodes[i], 0, node_infos.node_size);
+                *((size_t *) nodes[i]) = i;
+            }
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: %zu node creations | ",
+                            allocs[i_alloc], *nb);
+            LOG_INFO(log, "%s: node allocation throughput: %.0f nodes/s", allocs[i_alloc],
+                     BENCH_TM_GET_US(tm_bench) > 0
+                     ? (double) *nb * 1000000.0 / BENCH_TM_GET_US(tm_bench) : 0.0);
+
+            /* free then allocate again every other node, as a remove/insert churn would */
+            BENCHS_START(tm_bench, cpu_bench);
+            for (size_t i = 0; i < *nb; i += 2) {
+                if (nodes[i] == NULL)
+                    continue ;
+                if (i_alloc)
+                    avltree_test_pool_free(&pool, nodes[i]);
+                else
+                    free(nodes[i]);
+            }
+            for (size_t i = 0; i < *nb; i += 2) {
+                if (nodes[i] == NULL)
+                    continue ;
+                if ((nodes[i] = i_alloc ? avltree_test_pool_alloc(&pool)
+                                        : malloc(node_infos.node_size)) == NULL) {
+                    ++n_alloc_errors;
+                    continue ;
+                }
+                *((size_t *) nodes[i]) = i;
+            }
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: %zu node frees+allocations | ",
+                            allocs[i_alloc], *nb / 2);
+
+            for (size_t i = 0; i < *nb; ++i) {
+                if (nodes[i] != NULL)
+                    sum += *((size_t *) nodes[i]);
+            }
+            if (n_alloc_errors != 0 || sum != *nb * (*nb - 1) / 2) {
+                LOG_ERROR(log, "error: %s: %zu allocation errors, node sum %zu (expected %zu)",
+                          allocs[i_alloc], n_alloc_errors, sum, *nb * (*nb - 1) / 2);
+                ++nerrors;
+            }
+            if (i_alloc) {
+                LOG_INFO(log, "%s: %.01f bytes/elt in %zu slabs, for nodes of %zu bytes",
+                         allocs[i_alloc],
+                         (double) pool.n_slabs * (AVLTREE_TEST_POOL_ALIGN
+                             + AVLTREE_TEST_POOL_SLAB_NB * pool.node_size) / *nb,
+                         pool.n_slabs, node_infos.node_size);
+            }
+
+            BENCHS_START(tm_bench, cpu_bench);
+            if (i_alloc) {
+                avltree_test_pool_destroy(&pool);
+            } else {
+                for (size_t i = 0; i < *nb; ++i) {
+                    if (nodes[i] != NULL)
+                        free(nodes[i]);
+                }
+            }
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: freed %zu nodes | ",
+                            allocs[i_alloc], *nb);
+            LOG_INFO(log, "%s: node free throughput: %.0f nodes/s", allocs[i_alloc],
+                     BENCH_TM_GET_US(tm_bench) > 0
+                     ? (double) *nb * 1000000.0 / BENCH_TM_GET_US(tm_bench) : 0.0);
+        }
+        free(nodes);
+    }
+    return nerrors;
+}
+
+/* ****************************************
+ * B+-tree, for comparison with avltree
+ * ***************************************/
+/* Minimal B+-tree with the same element model as avltree (data is the key,
+ * ordered by cmp), with nodes sized for a few cache lines and leaves linked
+ * for sequential range scans. Only what the comparison needs is implemented
+ * (no remove). */
+#define TEST_BPTREE_FANOUT  ((4 * 64) / sizeof(void *))
+
+typedef struct test_bpnode_s {
+    unsigned int            n_keys;
+    int                     leaf;
+    void *                  keys[TEST_BPTREE_FANOUT];
+    union {
+        struct test_bpnode_s *  next;       /* leaves: next leaf */
+        struct test_bpnode_s *  children[TEST_BPTREE_FANOUT + 1];
+    } u;
+} test_bpnode_t;
+
+/* leaves are allocated without the children array */
+#define TEST_BPNODE_SIZE(leaf) \
+    ((leaf) ? offsetof(test_bpnode_t, u) + sizeof(test_bpnode_t *) : sizeof(test_bpnode_t))
+
+typedef struct {
+    test_bpnode_t *         root;
+    size_t                  n_elements;
+    avltree_cmpfun_t        cmp;
+} test_bptree_t;
+
+static test_bptree_t * test_bptree_create(avltree_cmpfun_t cmp) {
+    test_bptree_t * tree = calloc(1, sizeof(*tree));
+
+    if (tree != NULL)
+        tree->cmp = cmp;
+    return tree;
+}
+
+static test_bpnode_t * test_bpnode_create(int leaf) {
+    test_bpnode_t * node = calloc(1, TEST_BPNODE_SIZE(leaf));
+
+    if (node == NULL) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    node->leaf = leaf;
+    return node;
+}
+
+static void test_bpnode_free(test_bpnode_t * node) {
+    if (node == NULL)
+        return ;
+    if (!node->leaf) {
+        for (unsigned int i = 0; i <= node->n_keys; ++i)
+            test_bpnode_free(node->u.children[i]);
+    }
+    free(node);
+}
+
+static void test_bptree_free(test_bptree_t * tree) {
+    if (tree == NULL)
+        return ;
+    test_bpnode_free(tree->root);
+    free(tree);
+}
+
+/* inserts data under node, returns the new right sibling if node was split
+ * (its separator stored in *sep), or NULL. errno is set on error */
+static test_bpnode_t * test_bpnode_insert(test_bptree_t * tree, test_bpnode_t * node,
+                                          void * data, void ** sep) {
+    test_bpnode_t * right, * child_right = NULL;
+    unsigned int    i, mid;
+
+    for (i = 0; i < node->n_keys && tree->cmp(data, node->keys[i]) >= 0; ++i)
+        ; /* upper bound: equal elements are appended after existing ones */
+    if (!node->leaf) {
+        if ((child_right = test_bpnode_insert(tree, node->u.children[i], data, &data)) == NULL)
+            return NULL;
+        memmove(node->u.children + i + 2, node->u.children + i + 1,
+                (node->n_keys - i) * sizeof(*node->u.children));
+        node->u.children[i + 1] = child_right;
+    }
+    memmove(node->keys + i + 1, node->keys + i, (node->n_keys - i) * sizeof(*node->keys));
+    node->keys[i] = data;
+    if (++node->n_keys < TEST_BPTREE_FANOUT)
+        return NULL;
+
+    /* node is full: split it */
+    if ((right = test_bpnode_create(node->leaf)) == NULL)
+        return NULL;
+    mid = node->n_keys / 2;
+    if (node->leaf) {
+        right->n_keys = node->n_keys - mid;
+        memcpy(right->keys, node->keys + mid, right->n_keys * sizeof(*right->keys));
+        right->u.next = node->u.next;
+        node->u.next = right;
+        *sep = right->keys[0];
+    } else {
+        right->n_keys = node->n_keys - mid - 1;
+        memcpy(right->keys, node->keys + mid + 1, right->n_keys * sizeof(*right->keys));
+        memcpy(right->u.children, node->u.children + mid + 1,
+               (right->n_keys + 1) * sizeof(*right->u.children));
+        *sep = node->keys[mid];
+    }
+    node->n_keys = mid;
+    return right;
+}
+
+static void * test_bptree_insert(test_bptree_t * tree, void * data) {
+    test_bpnode_t * right, * root;
+    void *          sep;
+
+    if (tree->root == NULL && (tree->root = test_bpnode_create(1)) == NULL)
+        return NULL;
+    errno = 0;
+    if ((right = test_bpnode_insert(tree, tree->root, data, &sep)) != NULL) {
+        if ((root = test_bpnode_create(0)) == NULL)
+            return NULL;
+        root->n_keys = 1;
+        root->keys[0] = sep;
+        root->u.children[0] = tree->root;
+        root->u.children[1] = right;
+        tree->root = root;
+    } else if (errno != 0) {
+        return NULL;
+    }
+    ++tree->n_elements;
+    return data;
+}
+
+/* returns the leaf holding the first element >= min, and its index in *index */
+static test_bpnode_t * test_bptree_lower_bound(test_bptree_t * tree, const void * min,
+                                               unsigned int * index) {
+    test_bpnode_t * node = tree->root;
+    unsigned int    i = 0;
+
+    while (node != NULL) {
+        for (i = 0; i < node->n_keys && tree->cmp(node->keys[i], min) < 0; ++i)
+            ; /* nothing but loop */
+        if (node->leaf)
+            break ;
+        node = node->u.children[i];
+    }
+    for ( ; node != NULL && i >= node->n_keys; node = node->u.next)
+        i = 0;
+    *index = i;
+    return node;
+}
+
+static void * test_bptree_find(test_bptree_t * tree, const void * data) {
+    unsigned int    i;
+    test_bpnode_t * leaf = test_bptree_lower_bound(tree, data, &i);
+
+    if (leaf != NULL && tree->cmp(leaf->keys[i], data) == 0) {
+        errno = 0;
+        return leaf->keys[i];
+    }
+    errno = ENOENT;
+    return NULL;
+}
+
+/* calls visit on each element in [min,max], returns the number of visited elements */
+static size_t test_bptree_visit_range(test_bptree_t * tree, const void * min, const void * max,
+                                      void (*visit)(void *, void *), void * user_data) {
+    unsigned int    i;
+    size_t          count = 0;
+
+    for (test_bpnode_t * leaf = test_bptree_lower_bound(tree, min, &i);
+            leaf != NULL; leaf = leaf->u.next, i = 0) {
+        for ( ; i < leaf->n_keys; ++i) {
+            if (tree->cmp(leaf->keys[i], max) > 0)
+                return count;
+            visit(leaf->keys[i], user_data);
+            ++count;
+        }
+    }
+    return count;
+}
+
+static void avltree_test_bptree_sum(void * data, void * user_data) {
+    *((long *) user_data) += (long) data;
+}
+
+static unsigned int avltree_test_bptree(const options_test_t * opts, log_t * log) {
+    const size_t    nb_elts[] = { 1000 * 1000, SIZE_MAX, 10 * 1000 * 1000, 0 };
+    const size_t    range_elts = 10000, n_ranges = 1000;
+    unsigned int    nerrors = 0;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    for (const size_t * nb = nb_elts; *nb != 0; nb++) {
+        const unsigned int  seed = time(NULL);
+        /* values are spread on [0, nb*10[: range_elts elements span range_elts*10 values */
+        const long          span = (long) (range_elts * 10);
+        avltree_t *         tree;
+        test_bptree_t *     bptree;
+        size_t              n_found_avl = 0, n_found_bp = 0;
+        size_t              n_scan_avl = 0, n_scan_bp = 0;
+        long                sum_avl = 0, sum_bp = 0;
+
+        if (*nb == SIZE_MAX) { /* after size max this is only for TEST_bigtree */
+            if ((opts->test_mode & TEST_MASK(TEST_bigtree)) != 0) continue ; else break ;
+        }
+        LOG_INFO(log, "*************************************************");
+        LOG_INFO(log, "*** AVLTREE vs B+TREE (fanout %zu, leaf %zu / internal %zu bytes, "
+                      "%zu elements)", (size_t) TEST_BPTREE_FANOUT, TEST_BPNODE_SIZE(1),
+                 TEST_BPNODE_SIZE(0), *nb);
+        if ((tree = avltree_create(AFL_DEFAULT, intcmp, NULL)) == NULL
+        ||  (bptree = test_bptree_create(intcmp)) == NULL) {
+            LOG_ERROR(log, "error creating trees: %s", strerror(errno));
+            if (tree != NULL)
+                avltree_free(tree);
+            ++nerrors;
+            continue ;
+        }
+
+        /* insert */
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < *nb; ++i) {
+            void * value = LG(rand() % (*nb * 10));
+            if (avltree_insert(tree, value) != value && errno != 0)
+                ++nerrors;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree insert x %zu | ", *nb);
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < *nb; ++i) {
+            void * value = LG(rand() % (*nb * 10));
+            if (test_bptree_insert(bptree, value) != value && errno != 0)
+                ++nerrors;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "b+tree insert x %zu | ", *nb);
+
+        /* point lookups, on the same sequence of values */
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < *nb; ++i) {
+            void * value = LG(rand() % (*nb * 10));
+            if (avltree_find(tree, value) == value)
+                ++n_found_avl;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree find x %zu | ", *nb);
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < *nb; ++i) {
+            void * value = LG(rand() % (*nb * 10));
+            if (test_bptree_find(bptree, value) == value)
+                ++n_found_bp;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "b+tree find x %zu | ", *nb);
+
+        /* range scans of about range_elts elements */
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < n_ranges; ++i) {
+            long                    min = rand() % (*nb * 10), max = min + span - 1;
+            avltree_iterator_t *    iterator;
+            void *                  data;
+
+            if ((iterator = avltree_iterator_create_inrange(tree, LG(min), LG(max),
+                                                            AVH_INFIX)) == NULL) {
+                ++nerrors;
+                continue ;
+            }
+            while ((data = avltree_iterator_next(iterator)) != NULL || errno == 0) {
+                sum_avl += (long) data;
+                ++n_scan_avl;
+            }
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree range scans %zu x ~%zu | ",
+                        n_ranges, range_elts);
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < n_ranges; ++i) {
+            long min = rand() % (*nb * 10), max = min + span - 1;
+            n_scan_bp += test_bptree_visit_range(bptree, LG(min), LG(max),
+                                                 avltree_test_bptree_sum, &sum_bp);
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "b+tree range scans %zu x ~%zu | ",
+                        n_ranges, range_elts);
+
+        if (bptree->n_elements != avltree_count(tree) || n_found_bp != n_found_avl
+        ||  n_found_avl != *nb || n_scan_bp != n_scan_avl || sum_bp != sum_avl) {
+            LOG_ERROR(log, "error: avltree/b+tree mismatch: count %zu/%zu, found %zu/%zu/%zu, "
+                           "scanned %zu/%zu, sum %ld/%ld",
+                      avltree_count(tree), bptree->n_elements, n_found_avl, n_found_bp, *nb,
+                      n_scan_avl, n_scan_bp, sum_avl, sum_bp);
+            ++nerrors;
+        }
+
+        BENCHS_START(tm_bench, cpu_bench);
+        avltree_free(tree);
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree free x %zu | ", *nb);
+        BENCHS_START(tm_bench, cpu_bench);
+        test_bptree_free(bptree);
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "b+tree free x %zu | ", *nb);
+    }
+    return nerrors;
+}
+
+/* ****************************************
+ * Work-stealing parallel visit
+ * ***************************************/
+typedef struct {
+    unsigned long           count;
+    unsigned long           acc;
+} avltree_test_work_t;
+
+/* some cpu work per node, so that the visit is not only memory bound */
+static inline unsigned long avltree_test_work_node(const void * data) {
+    unsigned long x = (unsigned long) data + 1;
+
+    for (unsigned int i = 0; i < 32; ++i) {
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdUL;
+    }
+    return x;
+}
+
+static AVLTREE_DECLARE_VISITFUN(visit_work, node_data, context, user_data) {
+    avltree_test_work_t * work = (avltree_test_work_t *) user_data;
+
+    if ((context->state & AVH_MERGE) != 0) {
+        avltree_test_work_t * job_work = (avltree_test_work_t *) context->data;
+        work->count += job_work->count;
+        work->acc += job_work->acc;
+        return AVS_CONTINUE;
+    }
+    work->acc += avltree_test_work_node(node_data);
+    ++work->count;
+    return AVS_CONTINUE;
+}
+
+/* deque of subtrees: the owner pushes and pops at the bottom, thieves take
+ * from the top, where the subtrees nearest to the root are. */
+typedef struct {
+    pthread_mutex_t         lock;
+    avltree_node_t **       nodes;
+    size_t                  top;
+    size_t                  bottom;
+    size_t                  size;
+} avltree_test_ws_deque_t;
+
+typedef struct {
+    unsigned int                n_workers;
+    unsigned int                n_idle;
+    pthread_mutex_t             idle_lock;
+    avltree_test_ws_deque_t *   deques;
+    const int *                 cpus;           /* cpu of each worker, or NULL */
+    unsigned int                n_pin_errors;
+} avltree_test_ws_t;
+
+typedef struct {
+    avltree_test_ws_t *     ws;
+    unsigned int            id;
+    unsigned long           n_steals;
+    avltree_test_work_t     work;
+} avltree_test_ws_worker_t;
+
+static int avltree_test_ws_push(avltree_test_ws_deque_t * deque, avltree_node_t * node) {
+    int ret = 0;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom == deque->size) {
+        if (deque->top > 0) {
+            memmove(deque->nodes, deque->nodes + deque->top,
+                    (deque->bottom - deque->top) * sizeof(*deque->nodes));
+            deque->bottom -= deque->top;
+            deque->top = 0;
+        } else {
+            size_t              size = deque->size ? deque->size * 2 : 64;
+            avltree_node_t **   nodes = realloc(deque->nodes, size * sizeof(*nodes));
+            if (nodes == NULL) {
+                ret = -1;
+            } else {
+                deque->nodes = nodes;
+                deque->size = size;
+            }
+        }
+    }
+    if (ret == 0)
+        deque->nodes[deque->bottom++] = node;
+    pthread_mutex_unlock(&deque->lock);
+    return ret;
+}
+
+static avltree_node_t * avltree_test_ws_pop(avltree_test_ws_deque_t * deque, int steal) {
+    avltree_node_t * node = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom) {
+        node = steal ? deque->nodes[deque->top++] : deque->nodes[--deque->bottom];
+        if (deque->top == deque->bottom)
+            deque->top = deque->bottom = 0;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return node;
+}
+
+static void * avltree_test_ws_worker(void * vdata) {
+    avltree_test_ws_worker_t *  worker = (avltree_test_ws_worker_t *) vdata;
+    avltree_test_ws_t *         ws = worker->ws;
+    avltree_test_ws_deque_t *   deque = &(ws->deques[worker->id]);
+    avltree_node_t *            node;
+    long                        ret = AVS_FINISHED;
+
+    if (ws->cpus != NULL && test_cpu_pin(ws->cpus[worker->id]) != 0) {
+        pthread_mutex_lock(&ws->idle_lock);
+        ++ws->n_pin_errors;
+        pthread_mutex_unlock(&ws->idle_lock);
+    }
+    node = avltree_test_ws_pop(deque, 0);
+
+    while (1) {
+        /* visit own subtrees, depth-first, leaving right children to thieves */
+        while (node != NULL) {
+            avltree_node_t * left = avltree_node_left(node), * right = avltree_node_right(node);
+
+            worker->work.acc += avltree_test_work_node(avltree_node_data(node));
+            ++worker->work.count;
+            if (right != NULL) {
+                if (left == NULL) {
+                    node = right;
+                    continue ;
+                }
+                if (avltree_test_ws_push(deque, right) != 0) {
+                    ret = AVS_ERROR;
+                }
+            }
+            node = left != NULL ? left : avltree_test_ws_pop(deque, 0);
+        }
+        /* own deque is empty: steal, or stop when every worker is idle,
+         * as subtrees are only pushed by workers which are not idle. */
+        pthread_mutex_lock(&ws->idle_lock);
+        ++ws->n_idle;
+        pthread_mutex_unlock(&ws->idle_lock);
+        while (node == NULL) {
+            unsigned int n_idle;
+
+            for (unsigned int i = 1; i < ws->n_workers && node == NULL; ++i) {
+                node = avltree_test_ws_pop(&(ws->deques[(worker->id + i) % ws->n_workers]), 1);
+            }
+            pthread_mutex_lock(&ws->idle_lock);
+            if (node != NULL)
+                --ws->n_idle;
+            n_idle = ws->n_idle;
+            pthread_mutex_unlock(&ws->idle_lock);
+            if (node != NULL) {
+                ++worker->n_steals;
+            } else if (n_idle == ws->n_workers) {
+                return (void *) ret;
+            } else {
+                sched_yield();
+            }
+        }
+    }
+}
+
+/* visits the tree with n_workers vjobs, pinned on cpus[] if not NULL (failures
+ * to pin are counted in *n_pin_errors), returns AVS_FINISHED or AVS_ERROR */
+static int avltree_test_ws_run(avltree_t * tree, unsigned int n_workers, const int * cpus,
+                               avltree_test_work_t * work, unsigned long * n_steals,
+                               unsigned int * n_pin_errors) {
+    avltree_test_ws_t           ws = { .n_workers = n_workers, .n_idle = 0, .cpus = cpus,
+                                       .n_pin_errors = 0 };
+    avltree_test_ws_worker_t *  workers;
+    vjob_t **                   jobs;
+    int                         ret = AVS_FINISHED;
+
+    work->count = work->acc = 0;
+    *n_steals = 0;
+    if ((workers = calloc(n_workers, sizeof(*workers))) == NULL
+    ||  (jobs = calloc(n_workers, sizeof(*jobs))) == NULL
+    ||  (ws.deques = calloc(n_workers, sizeof(*ws.deques))) == NULL) {
+        if (workers != NULL) {
+            free(workers);
+            if (jobs != NULL)
+                free(jobs);
+        }
+        return AVS_ERROR;
+    }
+    pthread_mutex_init(&ws.idle_lock, NULL);
+    for (unsigned int i = 0; i < n_workers; ++i) {
+        pthread_mutex_init(&(ws.deques[i].lock), NULL);
+        workers[i].ws = &ws;
+        workers[i].id = i;
+    }
+    if (tree->root != NULL && avltree_test_ws_push(&(ws.deques[0]), tree->root) != 0) {
+        ret = AVS_ERROR;
+    }
+    /* workers which could not be started are idle from the beginning, and they
+     * are counted before any started worker can check n_idle to stop. */
+    pthread_mutex_lock(&ws.idle_lock);
+    for (unsigned int i = 0; i < n_workers; ++i) {
+        if ((jobs[i] = vjob_run(avltree_test_ws_worker, &(workers[i]))) == NULL)
+            ++ws.n_idle;
+    }
+    pthread_mutex_unlock(&ws.idle_lock);
+    for (unsigned int i = 0; i < n_workers; ++i) {
+        if (jobs[i] == NULL || (long) vjob_waitandfree(jobs[i]) != AVS_FINISHED) {
+            ret = AVS_ERROR;
+        }
+        work->count += workers[i].work.count;
+        work->acc += workers[i].work.acc;
+        *n_steals += workers[i].n_steals;
+        pthread_mutex_destroy(&(ws.deques[i].lock));
+        if (ws.deques[i].nodes != NULL)
+            free(ws.deques[i].nodes);
+    }
+    if (n_pin_errors != NULL) {
+        *n_pin_errors = ws.n_pin_errors;
+    }
+    pthread_mutex_destroy(&ws.idle_lock);
+    free(ws.deques);
+    free(jobs);
+    free(workers);
+    return ret;
+}
+
+static unsigned int avltree_test_ws_visit(const options_test_t * opts, log_t * log) {
+    const size_t        nb_elts[] = { 1000 * 1000, SIZE_MAX, 10 * 1000 * 1000, 0 };
+    static const char * shapes[] = { "balanced", "random-bst", "comb" };
+    static const char * placements[] = { "free", "one-per-core", "compact" };
+    const unsigned int  n_cpus = vjob_cpu_nb() > 0 ? vjob_cpu_nb() : 1;
+    unsigned int        nerrors = 0;
+    test_topo_t         topo;
+    int                 topo_ret;
+    int *               cpus = NULL;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    if ((topo_ret = test_topo_get(&topo)) < 0
+    ||  (cpus = malloc(topo.n_cpus * sizeof(*cpus))) == NULL) {
+        LOG_ERROR(log, "error getting cpu topology: %s", strerror(errno));
+        topo_ret = -1;
+        ++nerrors;
+    } else {
+        LOG_INFO(log, "cpu topology%s: %u cpus, %u cores (%u smt threads/core), %u nodes",
+                 topo_ret == 0 ? "" : " (default)", topo.n_cpus, topo.n_cores,
+                 topo.n_cpus / (topo.n_cores ? topo.n_cores : 1), topo.n_nodes);
+    }
+
+    for (const size_t * nb = nb_elts; *nb != 0; nb++) {
+        if (*nb == SIZE_MAX) { /* after size max this is only for TEST_bigtree */
+            if ((opts->test_mode & TEST_MASK(TEST_bigtree)) != 0) continue ; else break ;
+        }
+        for (unsigned int i_shape = 0; i_shape < PTR_COUNT(shapes); ++i_shape) {
+            /* comb: a right spine of 100 nodes, each with a random left subtree
+             * (blocks have at least 2 elements, for rand() % (comb_block - 1)) */
+            const size_t            comb_block = *nb / 100 > 2 ? *nb / 100 : 2;
+            avltree_test_work_t     ref = { 0, 0 }, work;
+            unsigned long           n_steals;
+            avltree_t *             tree;
+
+            LOG_INFO(log, "*************************************************");
+            LOG_INFO(log, "*** PARALLEL VISITS of %s tree (%zu elements)", shapes[i_shape], *nb);
+            if ((tree = avltree_create(AFL_DEFAULT, intcmp, NULL)) == NULL) {
+                LOG_ERROR(log, "error creating tree: %s", strerror(errno));
+                ++nerrors;
+                continue ;
+            }
+            BENCHS_START(tm_bench, cpu_bench);
+            for (size_t i = 0; i < *nb; ++i) {
+                void * value, * result;
+                if (i_shape == 0) {
+                    result = avltree_insert(tree, (value = LG(rand() % (*nb * 10))));
+                } else if (i_shape == 1) {
+                    result = avltree_insert_rec(tree, (value = LG(rand() % (*nb * 10))));
+                } else {
+                    /* first element of each block is its maximum, then the rest */
+                    size_t block = i / comb_block, first = block * comb_block;
+                    value = LG(i == first ? first + comb_block - 1
+                                          : first + rand() % (comb_block - 1));
+                    result = avltree_insert_rec(tree, value);
+                }
+                if (result != value && errno != 0) {
+                    ++nerrors;
+                }
+            }
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "creation of %s tree (%zu nodes) | ",
+                            shapes[i_shape], *nb);
+
+            BENCHS_START(tm_bench, cpu_bench);
+            if (avltree_visit(tree, visit_work, &ref, AVH_PREFIX) != AVS_FINISHED) {
+                ++nerrors;
+            }
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: PREFIX visit (%lu nodes) | ",
+                            shapes[i_shape], ref.count);
+
+            work.count = work.acc = 0;
+            BENCHS_START(tm_bench, cpu_bench);
+            if (avltree_visit(tree, visit_work, &work,
+                              AVH_PARALLEL_DUPDATA(AVH_PREFIX | AVH_MERGE, sizeof(work)))
+                    != AVS_FINISHED) {
+                ++nerrors;
+            }
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: PARALLEL_PREFIX visit (%lu nodes) | ",
+                            shapes[i_shape], work.count);
+            if (work.count != ref.count || work.acc != ref.acc || ref.count != *nb) {
+                LOG_ERROR(log, "error: %s: PARALLEL_PREFIX visit: %lu nodes (expected %zu)",
+                          shapes[i_shape], work.count, *nb);
+                ++nerrors;
+            }
+
+            /* thread counts: 1, 2, 4, ..., n_cpus */
+            for (unsigned int n_threads = 1, last = 0; !last;
+                    last = (n_threads >= n_cpus),
+                    n_threads = (n_threads * 2 > n_cpus ? n_cpus : n_threads * 2)) {
+                BENCHS_START(tm_bench, cpu_bench);
+                if (avltree_test_ws_run(tree, n_threads, NULL, &work, &n_steals,
+                                        NULL) != AVS_FINISHED) {
+                    ++nerrors;
+                }
+                BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: work-stealing visit "
+                                "(%u threads, %lu steals, %lu nodes) | ",
+                                shapes[i_shape], n_threads, n_steals, work.count);
+                if (work.count != ref.count || work.acc != ref.acc) {
+                    LOG_ERROR(log, "error: %s: work-stealing visit(%u threads): %lu nodes "
+                                   "(expected %lu)", shapes[i_shape], n_threads,
+                              work.count, ref.count);
+                    ++nerrors;
+                }
+            }
+
+            /* placement of one worker per physical core */
+            for (int placement = 0; topo_ret >= 0 && placement < TEST_PIN_NB; ++placement) {
+                unsigned int    n_pin_errors = 0;
+                const int *     pin = test_topo_placement(&topo, placement,
+                                                          topo.n_cores, cpus);
+
+                if (placement != TEST_PIN_NONE && pin == NULL)
+                    continue ;
+                BENCHS_START(tm_bench, cpu_bench);
+                if (avltree_test_ws_run(tree, topo.n_cores, pin, &work, &n_steals,
+                                        &n_pin_errors) != AVS_FINISHED) {
+                    ++nerrors;
+                }
+                BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: work-stealing visit, %s placement "
+                                "(%u threads, %lu steals, %u not pinned) | ",
+                                shapes[i_shape], placements[placement], topo.n_cores,
+                                n_steals, n_pin_errors);
+                if (work.count != ref.count || work.acc != ref.acc) {
+                    LOG_ERROR(log, "error: %s: work-stealing visit(%s placement): %lu nodes "
+                                   "(expected %lu)", shapes[i_shape], placements[placement],
+                              work.count, ref.count);
+                    ++nerrors;
+                }
+            }
+            avltree_free(tree);
+        }
+    }
+    if (cpus != NULL)
+        free(cpus);
+    test_topo_free(&topo);
+    return nerrors;
+}
+
+/* ****************************************
+ * Concurrent readers and writers
+ * ***************************************/
+enum {
+    AVLTREE_TEST_CC_MUTEX = 0,   /* every access under a mutex */
+    AVLTREE_TEST_CC_RWLOCK,      /* readers share a rwlock, writers take it exclusively */
+    AVLTREE_TEST_CC_OPTIMISTIC,  /* readers take no lock, and validate with the tree version */
+    AVLTREE_TEST_CC_NB
+};
+
+/* Writers serialise on a mutex and make the version odd while modifying the tree.
+ * Readers traverse without lock and retry if the version was odd or has changed.
+ * Writes are inserts only, so nodes seen by readers are never freed. */
+typedef struct {
+    avltree_t *             tree;
+    pthread_mutex_t         lock;
+    pthread_rwlock_t        rwlock;
+    volatile unsigned long  version;
+} avltree_test_cc_t;
+
+typedef struct {
+    avltree_test_cc_t *     cc;
+    int                     mode;
+    unsigned int            id;
+    unsigned int            seed;
+    unsigned int            write_percent;
+    size_t                  n_ops;
+    size_t                  n_init;
+    size_t                  n_reads;
+    size_t                  n_found;
+    size_t                  n_writes;
+    size_t                  n_retries;
+    size_t                  n_errors;
+} avltree_test_cc_job_t;
+
+/* maximum number of retries of an optimistic read, before taking the writer lock */
+#define AVLTREE_TEST_CC_MAX_RETRIES  16
+/* bound of an optimistic traversal: it can loop while a rotation is in progress */
+#define AVLTREE_TEST_CC_MAX_STEPS    128
+
+static void * avltree_test_cc_find_optimistic(avltree_test_cc_t * cc, const void * data,
+                                              size_t * n_retries) {
+    for (unsigned int retry = 0; retry < AVLTREE_TEST_CC_MAX_RETRIES; ++retry, ++(*n_retries)) {
+        unsigned long       version = cc->version;
+        avltree_node_t *    node;
+        void *              found = NULL;
+        unsigned int        steps = 0;
+
+        if ((version & 1) != 0) {
+            sched_yield();
+            continue ;
+        }
+        __sync_synchronize();
+        for (node = cc->tree->root; node != NULL && steps < AVLTREE_TEST_CC_MAX_STEPS; ++steps) {
+            void * node_data = avltree_node_data(node);
+            int cmp = cc->tree->cmp(data, node_data);
+            if (cmp == 0) {
+                found = node_data;
+                break ;
+            }
+            node = cmp < 0 ? avltree_node_left(node) : avltree_node_right(node);
+        }
+        __sync_synchronize();
+        if (cc->version == version && steps < AVLTREE_TEST_CC_MAX_STEPS) {
+            return found;
+        }
+    }
+    /* too many conflicts: read under the writer lock */
+    void * found;
+    pthread_mutex_lock(&cc->lock);
+    found = avltree_find(cc->tree, data);
+    pthread_mutex_unlock(&cc->lock);
+    return found;
+}
+
+static void * avltree_test_cc_find(avltree_test_cc_t * cc, int mode, const void * data,
+                                   size_t * n_retries) {
+    void * found;
+
+    switch (mode) {
+        case AVLTREE_TEST_CC_OPTIMISTIC:
+            return avltree_test_cc_find_optimistic(cc, data, n_retries);
+        case AVLTREE_TEST_CC_RWLOCK:
+            pthread_rwlock_rdlock(&cc->rwlock);
+            found = avltree_find(cc->tree, data);
+            pthread_rwlock_unlock(&cc->rwlock);
+            return found;
+        default:
+            pthread_mutex_lock(&cc->lock);
+            found = avltree_find(cc->tree, data);
+            pthread_mutex_unlock(&cc->lock);
+            return found;
+    }
+}
+
+static void * avltree_test_cc_insert(avltree_test_cc_t * cc, int mode, void * data) {
+    void * result;
+
+    if (mode == AVLTREE_TEST_CC_RWLOCK) {
+        pthread_rwlock_wrlock(&cc->rwlock);
+        result = avltree_insert(cc->tree, data);
+        pthread_rwlock_unlock(&cc->rwlock);
+        return result;
+    }
+    pthread_mutex_lock(&cc->lock);
+    if (mode == AVLTREE_TEST_CC_OPTIMISTIC) {
+        ++cc->version;
+        __sync_synchronize();
+    }
+    result = avltree_insert(cc->tree, data);
+    if (mode == AVLTREE_TEST_CC_OPTIMISTIC) {
+        __sync_synchronize();
+        ++cc->version;
+    }
+    pthread_mutex_unlock(&cc->lock);
+    return result;
+}
+
+static void * avltree_test_cc_job(void * vdata) {
+    avltree_test_cc_job_t *  job = (avltree_test_cc_job_t *) vdata;
+
+    for (size_t i = 0; i < job->n_ops; ++i) {
+        if ((unsigned int) (rand_r(&job->seed) % 100) < job->write_percent) {
+            /* odd values, unique for each job and operation */
+            void * value = LG(2 * (job->id * job->n_ops + i) + 1);
+            if (avltree_test_cc_insert(job->cc, job->mode, value) != value)
+                ++job->n_errors;
+            ++job->n_writes;
+        } else {
+            /* even values, all present since the tree initialization */
+            void * value = LG(2 * (rand_r(&job->seed) % job->n_init));
+            if (avltree_test_cc_find(job->cc, job->mode, value, &job->n_retries) == value)
+                ++job->n_found;
+            ++job->n_reads;
+        }
+    }
+    return NULL;
+}
+
+static unsigned int avltree_test_concurrent(const options_test_t * opts, log_t * log) {
+    static const char *         modes[] = { "mutex", "rwlock", "optimistic" };
+    static const unsigned       write_percents[] = { 5, 50 };
+    const int                   big = (opts->test_mode & TEST_MASK(TEST_bigtree)) != 0;
+    const size_t                n_init = big ? 1000 * 1000 : 100 * 1000;
+    const size_t                n_ops = big ? 4 * 1000 * 1000 : 1000 * 1000;
+    const unsigned int          n_cpus = vjob_cpu_nb() > 0 ? vjob_cpu_nb() : 1;
+    avltree_test_cc_job_t *     jobs_data;
+    vjob_t **                   jobs;
+    unsigned int                nerrors = 0;
+    BENCH_TM_DECL(tm_bench);
+
+    if ((jobs_data = calloc(n_cpus, sizeof(*jobs_data))) == NULL
+    ||  (jobs = calloc(n_cpus, sizeof(*jobs))) == NULL) {
+        LOG_ERROR(log, "error: cannot allocate concurrent jobs");
+        if (jobs_data != NULL)
+            free(jobs_data);
+        return 1;
+    }
+    LOG_INFO(log, "*************************************************");
+    LOG_INFO(log, "*** CONCURRENT TREE ACCESS (%zu elements, %zu operations)", n_init, n_ops);
+
+    for (unsigned int i_wp = 0; i_wp < PTR_COUNT(write_percents); ++i_wp) {
+        for (int mode = 0; mode < AVLTREE_TEST_CC_NB; ++mode) {
+            /* thread counts: 1, 2, 4, ..., n_cpus */
+            for (unsigned int n_threads = 1, last = 0; !last;
+                    last = (n_threads >= n_cpus),
+                    n_threads = (n_threads * 2 > n_cpus ? n_cpus : n_threads * 2)) {
+                avltree_test_cc_t   cc = { .version = 0 };
+                size_t              n_reads = 0, n_found = 0, n_writes = 0, n_retries = 0;
+                size_t              n_errors = 0;
+                long                duration;
+
+                if ((cc.tree = avltree_create(AFL_DEFAULT, intcmp, NULL)) == NULL) {
+                    LOG_ERROR(log, "error creating tree: %s", strerror(errno));
+                    ++nerrors;
+                    continue ;
+                }
+                pthread_mutex_init(&cc.lock, NULL);
+                pthread_rwlock_init(&cc.rwlock, NULL);
+                for (size_t i = 0; i < n_init; ++i) {
+                    /* even values 0..2*n_init, in scattered order */
+                    void * value = LG(2 * ((i * 2654435761UL) % n_init));
+                    if (avltree_insert(cc.tree, value) != value && errno != 0)
+                        ++n_errors;
+                }
+
+                BENCH_TM_START(tm_bench);
+                for (unsigned int i = 0; i < n_threads; ++i) {
+                    jobs_data[i] = (avltree_test_cc_job_t) {
+                        .cc = &cc, .mode = mode, .id = i, .seed = 1 + i,
+                        .write_percent = write_percents[i_wp],
+                        .n_ops = n_ops / n_threads, .n_init = n_init };
+                    jobs[i] = vjob_run(avltree_test_cc_job, &(jobs_data[i]));
+                }
+                for (unsigned int i = 0; i < n_threads; ++i) {
+                    if (jobs[i] == NULL) {
+                        ++n_errors;
+                        continue ;
+                    }
+                    vjob_waitandfree(jobs[i]);
+                    n_reads += jobs_data[i].n_reads;
+                    n_found += jobs_data[i].n_found;
+                    n_writes += jobs_data[i].n_writes;
+                    n_retries += jobs_data[i].n_retries;
+                    n_errors += jobs_data[i].n_errors;
+                }
+                BENCH_TM_STOP(tm_bench);
+                duration = BENCH_TM_GET(tm_bench);
+
+                LOG_INFO(log, "concurrent %s (%u%% writes) threads=%u: %zu reads, %zu writes, "
+                              "%zu retries in %ld ms (%.0f kops/s)",
+                         modes[mode], write_percents[i_wp], n_threads, n_reads, n_writes,
+                         n_retries, duration,
+                         duration > 0 ? (double) (n_reads + n_writes) / duration : 0.0);
+                if (n_errors != 0 || n_found != n_reads
+                ||  avltree_count(cc.tree) != n_init + n_writes
+                ||  avlprint_rec_check_balance(cc.tree->root, log) != 0) {
+                    LOG_ERROR(log, "error: concurrent %s (%u%% writes) threads=%u: "
+                                   "%zu errors, %zu/%zu found, count %zu (expected %zu)",
+                              modes[mode], write_percents[i_wp], n_threads, n_errors,
+                              n_found, n_reads, avltree_count(cc.tree), n_init + n_writes);
+                    ++nerrors;
+                }
+                avltree_free(cc.tree);
+                pthread_rwlock_destroy(&cc.rwlock);
+                pthread_mutex_destroy(&cc.lock);
+            }
+        }
+    }
+    free(jobs);
+    free(jobs_data);
+    return nerrors;
+}
+
+/* ****************************************
+ * Rank, select, and to_array with exact offsets
+ * ***************************************/
+/* number of elements < data, by iteration: O(rank) */
+static size_t avltree_test_rank(avltree_t * tree, const void * data) {
+    size_t rank = 0;
+
+    AVLTREE_FOREACH_DATA(tree, elt, void *, AVH_INFIX) {
+        if (tree->cmp(elt, data) >= 0)
+            break ;
+        ++rank;
+    }
+    return rank;
+}
+
+/* k-th element (from 0) by iteration: O(k) */
+static void * avltree_test_select(avltree_t * tree, size_t k) {
+    void * found = NULL;
+
+    errno = ENOENT;
+    AVLTREE_FOREACH_DATA(tree, elt, void *, AVH_INFIX) {
+        if (k-- == 0) {
+            found = elt;
+            errno = 0;
+            break ;
+        }
+    }
+    return found;
+}
+
+static AVLTREE_DECLARE_VISITFUN(visit_count, node_data, context, user_data) {
+    (void) node_data;
+    (void) context;
+    ++(*((size_t *) user_data));
+    return AVS_CONTINUE;
+}
+
+/* number of elements in [min,max] with avltree_visit_range(): O(log n + count) */
+static size_t avltree_test_count_range(avltree_t * tree, void * min, void * max) {
+    size_t count = 0;
+
+    avltree_visit_range(tree, min, max, visit_count, &count, 0);
+    return count;
+}
+
+/* a part of the infix order: a single node, or a whole subtree */
+typedef struct {
+    avltree_node_t *    node;
+    int                 subtree;
+    size_t              count;
+    size_t              offset;
+} avltree_test_segment_t;
+
+typedef struct {
+    avltree_test_segment_t *    segments;
+    size_t                      n_segments;
+    unsigned int                id;
+    unsigned int                n_jobs;
+    void **                     array;
+} avltree_test_segment_job_t;
+
+static size_t avltree_test_segments_get(avltree_node_t * node, unsigned int depth,
+                                        avltree_test_segment_t * segments, size_t n) {
+    if (node == NULL)
+        return n;
+    if (depth == 0) {
+        segments[n++] = (avltree_test_segment_t) { .node = node, .subtree = 1 };
+        return n;
+    }
+    n = avltree_test_segments_get(avltree_node_left(node), depth - 1, segments, n);
+    segments[n++] = (avltree_test_segment_t) { .node = node, .subtree = 0, .count = 1 };
+    return avltree_test_segments_get(avltree_node_right(node), depth - 1, segments, n);
+}
+
+static size_t avltree_test_fill_rec(avltree_node_t * node, void ** array, size_t i) {
+    for ( ; node != NULL; node = avltree_node_right(node)) {
+        i = avltree_test_fill_rec(avltree_node_left(node), array, i);
+        array[i++] = avltree_node_data(node);
+    }
+    return i;
+}
+
+/* first pass (array NULL) counts the subtrees of the job, second one fills them */
+static void * avltree_test_segment_job(void * vdata) {
+    avltree_test_segment_job_t * job = (avltree_test_segment_job_t *) vdata;
+
+    for (size_t i = job->id; i < job->n_segments; i += job->n_jobs) {
+        avltree_test_segment_t * segment = &(job->segments[i]);
+
+        if (job->array == NULL) {
+            if (segment->subtree)
+                segment->count = avlprint_rec_get_count(segment->node);
+        } else if (segment->subtree) {
+            avltree_test_fill_rec(segment->node, job->array, segment->offset);
+        } else {
+            job->array[segment->offset] = avltree_node_data(segment->node);
+        }
+    }
+    return NULL;
+}
+
+/* avltree_to_array(INFIX) where each job writes at its exact offset: the tree is cut
+ * in segments under a given depth, segments are counted in parallel, then filled in
+ * parallel from their prefix sums, without any merge step. */
+static size_t avltree_test_to_array_offsets(avltree_t * tree, unsigned int n_jobs,
+                                            void *** parray) {
+    unsigned int                    depth = 0;
+    size_t                          n_segments, offset = 0;
+    avltree_test_segment_t *        segments;
+    avltree_test_segment_job_t *    jobs_data;
+    vjob_t **                       jobs;
+
+    *parray = NULL;
+    while ((1U << depth) < 4 * n_jobs)
+        ++depth;
+    if ((segments = malloc((2UL << depth) * sizeof(*segments))) == NULL) {
+        return 0;
+    }
+    if ((jobs_data = calloc(n_jobs, sizeof(*jobs_data))) == NULL
+    ||  (jobs = calloc(n_jobs, sizeof(*jobs))) == NULL) {
+        if (jobs_data != NULL)
+            free(jobs_data);
+        free(segments);
+        return 0;
+    }
+    n_segments = avltree_test_segments_get(tree->root, depth, segments, 0);
+
+    for (unsigned int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+            for (size_t i = 0; i < n_segments; ++i) {
+                segments[i].offset = offset;
+                offset += segments[i].count;
+            }
+            if (offset == 0 || (*parray = malloc(offset * sizeof(**parray))) == NULL) {
+                offset = 0;
+                break ;
+            }
+        }
+        for (unsigned int i = 0; i < n_jobs; ++i) {
+            jobs_data[i] = (avltree_test_segment_job_t) {
+                .segments = segments, .n_segments = n_segments,
+                .id = i, .n_jobs = n_jobs, .array = *parray };
+            if ((jobs[i] = vjob_run(avltree_test_segment_job, &(jobs_data[i]))) == NULL)
+                avltree_test_segment_job(&(jobs_data[i]));
+        }
+        for (unsigned int i = 0; i < n_jobs; ++i) {
+            if (jobs[i] != NULL)
+                vjob_waitandfree(jobs[i]);
+        }
+    }
+    free(jobs);
+    free(jobs_data);
+    free(segments);
+    return offset;
+}
+
+static unsigned int avltree_test_order_stats(const options_test_t * opts, log_t * log) {
+    const size_t        nb_elts[] = { 1000 * 1000, SIZE_MAX, 10 * 1000 * 1000, 0 };
+    const size_t        n_queries = 100;
+    const unsigned int  n_cpus = vjob_cpu_nb() > 0 ? vjob_cpu_nb() : 1;
+    unsigned int        nerrors = 0;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    for (const size_t * nb = nb_elts; *nb != 0; nb++) {
+        const unsigned int  seed = time(NULL);
+        avltree_t *         tree;
+        void **             array = NULL, ** array_off = NULL;
+        size_t              n, n_off, n_bad = 0;
+
+        if (*nb == SIZE_MAX) { /* after size max this is only for TEST_bigtree */
+            if ((opts->test_mode & TEST_MASK(TEST_bigtree)) != 0) continue ; else break ;
+        }
+        LOG_INFO(log, "*************************************************");
+        LOG_INFO(log, "*** RANK/SELECT/COUNT_RANGE, TO_ARRAY (%zu elements)", *nb);
+        if ((tree = avltree_create(AFL_DEFAULT, intcmp, NULL)) == NULL) {
+            LOG_ERROR(log, "error creating tree: %s", strerror(errno));
+            ++nerrors;
+            continue ;
+        }
+        for (size_t i = 0; i < *nb; ++i) {
+            void * value = LG(rand() % (*nb * 10));
+            if (avltree_insert(tree, value) != value && errno != 0)
+                ++nerrors;
+        }
+
+        /* to_array: sequential, vlib parallel, and parallel with exact offsets */
+        BENCHS_START(tm_bench, cpu_bench);
+        n = avltree_to_array(tree, AVH_INFIX, &array);
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree_to_array(INFIX) x %zu | ", n);
+        BENCHS_START(tm_bench, cpu_bench);
+        n_off = avltree_to_array(tree, AVH_INFIX | AVH_PARALLEL, &array_off);
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree_to_array(INFIX|PARALLEL) x %zu | ",
+                        n_off);
+        if (array_off != NULL)
+            free(array_off);
+        BENCHS_START(tm_bench, cpu_bench);
+        n_off = avltree_test_to_array_offsets(tree, n_cpus, &array_off);
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "to_array with exact offsets (%u jobs) x %zu | ",
+                        n_cpus, n_off);
+        if (n != *nb || n_off != n || array == NULL || array_off == NULL
+        ||  memcmp(array, array_off, n * sizeof(*array)) != 0) {
+            LOG_ERROR(log, "error: to_array with offsets: %zu elements, expected %zu(%zu)",
+                      n_off, n, *nb);
+            ++nerrors;
+        }
+        if (array_off != NULL)
+            free(array_off);
+        if (array == NULL || n == 0) {
+            avltree_free(tree);
+            ++nerrors;
+            continue ;
+        }
+
+        /* rank, select, count_range by walking the tree, checked against the array */
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < n_queries; ++i) {
+            void *  value = array[rand() % n];
+            size_t  rank = avltree_test_rank(tree, value);
+            if (rank >= n || array[rank] != value || (rank > 0 && array[rank - 1] == value))
+                ++n_bad;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "rank (iterator) x %zu | ", n_queries);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < n_queries; ++i) {
+            size_t k = rand() % n;
+            if (avltree_test_select(tree, k) != array[k])
+                ++n_bad;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "select (iterator) x %zu | ", n_queries);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < n_queries; ++i) {
+            size_t k1 = rand() % n, k2 = k1 + rand() % (n - k1);
+            size_t count = avltree_test_count_range(tree, array[k1], array[k2]);
+            /* with doubles, elements equal to the bounds can be outside [k1,k2] */
+            while (k1 > 0 && array[k1 - 1] == array[k1])
+                --k1;
+            while (k2 + 1 < n && array[k2 + 1] == array[k2])
+                ++k2;
+            if (count != k2 - k1 + 1)
+                ++n_bad;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "count_range (visit_range) x %zu | ",
+                        n_queries);
+        if (n_bad != 0) {
+            LOG_ERROR(log, "error: rank/select/count_range: %zu bad results", n_bad);
+            ++nerrors;
+        }
+
+        free(array);
+        avltree_free(tree);
+    }
+    return nerrors;
+}
+
+/* ****************************************
+ * Allocation-free iteration
+ * ***************************************/
+/* An AVL tree of n nodes has a height < 1.4405 * log2(n + 2): 96 covers any size_t count */
+#define AVLTREE_TEST_INLINE_ITER_DEPTH  96
+
+/* infix iterator with an inline stack, to be declared on the caller stack */
+typedef struct {
+    avltree_node_t *    stack[AVLTREE_TEST_INLINE_ITER_DEPTH];
+    unsigned int        top;
+    int                 overflow;
+} avltree_test_inline_iterator_t;
+
+static inline void avltree_test_inline_iterator_push_left(avltree_test_inline_iterator_t * it,
+                                                          avltree_node_t * node) {
+    for ( ; node != NULL; node = avltree_node_left(node)) {
+        if (it->top >= AVLTREE_TEST_INLINE_ITER_DEPTH) {
+            it->overflow = 1; /* only possible on a tree which is not balanced */
+            return ;
+        }
+        it->stack[it->top++] = node;
+    }
+}
+
+static inline void avltree_test_inline_iterator_init(avltree_test_inline_iterator_t * it,
+                                                     avltree_t * tree) {
+    it->top = 0;
+    it->overflow = 0;
+    avltree_test_inline_iterator_push_left(it, tree->root);
+}
+
+/* returns 1 and stores the next element in *data, or 0 at the end (or on overflow) */
+static inline int avltree_test_inline_iterator_next(avltree_test_inline_iterator_t * it,
+                                                    void ** data) {
+    avltree_node_t * node;
+
+    if (it->top == 0 || it->overflow)
+        return 0;
+    node = it->stack[--it->top];
+    *data = avltree_node_data(node);
+    avltree_test_inline_iterator_push_left(it, avltree_node_right(node));
+    return 1;
+}
+
+static unsigned int avltree_test_inline_iterator(log_t * log) {
+    const size_t                    nb = 1000 * 1000, n_short = 100 * 1000, short_len = 10;
+    unsigned int                    nerrors = 0;
+    avltree_t *                     tree;
+    avltree_test_inline_iterator_t  it;
+    void *                          data;
+    long                            sum_ref = 0, sum = 0, prev;
+    size_t                          count;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    LOG_INFO(log, "*************************************************");
+    LOG_INFO(log, "*** ITERATORS: heap vs inline stack (%zu elements)", nb);
+    if ((tree = avltree_create(AFL_DEFAULT, intcmp, NULL)) == NULL) {
+        LOG_ERROR(log, "error creating tree: %s", strerror(errno));
+        return 1;
+    }
+    for (size_t i = 0; i < nb; ++i) {
+        void * value = LG(rand() % (nb * 10));
+        if (avltree_insert(tree, value) != value && errno != 0)
+            ++nerrors;
+    }
+
+    /* full iterations */
+    count = 0;
+    BENCHS_START(tm_bench, cpu_bench);
+    AVLTREE_FOREACH_DATA(tree, it_long, long, AVH_INFIX) {
+        sum_ref += it_long;
+        ++count;
+    }
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "AVLTREE_FOREACH_DATA(infix) x %zu | ", count);
+
+    count = 0;
+    prev = LONG_MIN;
+    BENCHS_START(tm_bench, cpu_bench);
+    avltree_test_inline_iterator_init(&it, tree);
+    while (avltree_test_inline_iterator_next(&it, &data)) {
+        if ((long) data < prev)
+            ++nerrors;
+        prev = (long) data;
+        sum += (long) data;
+        ++count;
+    }
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "inline iterator(infix) x %zu | ", count);
+    if (it.overflow || count != avltree_count(tree) || sum != sum_ref) {
+        LOG_ERROR(log, "error: inline iterator: %zu elements (expected %zu), overflow %d",
+                  count, avltree_count(tree), it.overflow);
+        ++nerrors;
+    }
+
+    /* many short loops, where the iterator setup dominates */
+    sum_ref = sum = 0;
+    BENCHS_START(tm_bench, cpu_bench);
+    for (size_t i = 0; i < n_short; ++i) {
+        count = 0;
+        AVLTREE_FOREACH_DATA(tree, it_long, long, AVH_INFIX) {
+            if (count++ >= short_len)
+                break ;
+            sum_ref += it_long;
+        }
+    }
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "AVLTREE_FOREACH_DATA(infix) %zu loops of %zu | ",
+                    n_short, short_len);
+    BENCHS_START(tm_bench, cpu_bench);
+    for (size_t i = 0; i < n_short; ++i) {
+        count = 0;
+        avltree_test_inline_iterator_init(&it, tree);
+        while (count++ < short_len && avltree_test_inline_iterator_next(&it, &data)) {
+            sum += (long) data;
+        }
+    }
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "inline iterator(infix) %zu loops of %zu | ",
+                    n_short, short_len);
+    if (sum != sum_ref) {
+        LOG_ERROR(log, "error: inline iterator: short loops sum %ld, expected %ld", sum, sum_ref);
+        ++nerrors;
+    }
+
+    avltree_free(tree);
+    return nerrors;
+}
+
+/* ****************************************
+ * Compact AVL tree with 32-bit indices
+ * ***************************************/
+/* Nodes live in one array and link each other with 32-bit indices (0 is NULL).
+ * The balance (-1,0,1) is stored in the 2 high bits of the left index, and the
+ * data pointer is stored inline: 16 bytes per node, with no malloc header. */
+#define AVLC_IDX_BITS   30
+#define AVLC_IDX_MASK   ((1U << AVLC_IDX_BITS) - 1)
+
+typedef struct {
+    uint32_t            left_bal;
+    uint32_t            right;
+    void *              data;
+} avlc_node_t;
+
+typedef struct {
+    avlc_node_t *       nodes;
+    uint32_t            root;
+    uint32_t            n_nodes;    /* including the NULL node 0 */
+    uint32_t            size;
+    avltree_cmpfun_t    cmp;
+} avlc_tree_t;
+
+#define AVLC_LEFT(t, i)     ((t)->nodes[i].left_bal & AVLC_IDX_MASK)
+#define AVLC_RIGHT(t, i)    ((t)->nodes[i].right)
+#define AVLC_BAL(t, i)      ((int) ((t)->nodes[i].left_bal >> AVLC_IDX_BITS) - 1)
+
+static inline void avlc_set_left(avlc_tree_t * t, uint32_t i, uint32_t left) {
+    t->nodes[i].left_bal = (t->nodes[i].left_bal & ~AVLC_IDX_MASK) | left;
+}
+static inline void avlc_set_bal(avlc_tree_t * t, uint32_t i, int bal) {
+    t->nodes[i].left_bal = (t->nodes[i].left_bal & AVLC_IDX_MASK)
+                           | ((uint32_t) (bal + 1) << AVLC_IDX_BITS);
+}
+
+static avlc_tree_t * avlc_create(avltree_cmpfun_t cmp) {
+    avlc_tree_t * t = calloc(1, sizeof(*t));
+
+    if (t != NULL) {
+        t->cmp = cmp;
+        t->n_nodes = 1;
+    }
+    return t;
+}
+
+static void avlc_free(avlc_tree_t * t) {
+    if (t == NULL)
+        return ;
+    if (t->nodes != NULL)
+        free(t->nodes);
+    free(t);
+}
+
+static size_t avlc_memorysize(avlc_tree_t * t) {
+    return sizeof(*t) + t->size * sizeof(*t->nodes);
+}
+
+static size_t avlc_count(avlc_tree_t * t) {
+    return t->n_nodes - 1;
+}
+
+/* n is left heavy by 2 */
+static uint32_t avlc_rebalance_left(avlc_tree_t * t, uint32_t n) {
+    uint32_t l = AVLC_LEFT(t, n), lr;
+
+    if (AVLC_BAL(t, l) < 0) {
+        avlc_set_left(t, n, AVLC_RIGHT(t, l));
+        AVLC_RIGHT(t, l) = n;
+        avlc_set_bal(t, n, 0);
+        avlc_set_bal(t, l, 0);
+        return l;
+    }
+    lr = AVLC_RIGHT(t, l);
+    AVLC_RIGHT(t, l) = AVLC_LEFT(t, lr);
+    avlc_set_left(t, n, AVLC_RIGHT(t, lr));
+    avlc_set_left(t, lr, l);
+    AVLC_RIGHT(t, lr) = n;
+    avlc_set_bal(t, l, AVLC_BAL(t, lr) > 0 ? -1 : 0);
+    avlc_set_bal(t, n, AVLC_BAL(t, lr) < 0 ? 1 : 0);
+    avlc_set_bal(t, lr, 0);
+    return lr;
+}
+
+/* n is right heavy by 2 */
+static uint32_t avlc_rebalance_right(avlc_tree_t * t, uint32_t n) {
+    uint32_t r = AVLC_RIGHT(t, n), rl;
+
+    if (AVLC_BAL(t, r) > 0) {
+        AVLC_RIGHT(t, n) = AVLC_LEFT(t, r);
+        avlc_set_left(t, r, n);
+        avlc_set_bal(t, n, 0);
+        avlc_set_bal(t, r, 0);
+        return r;
+    }
+    rl = AVLC_LEFT(t, r);
+    avlc_set_left(t, r, AVLC_RIGHT(t, rl));
+    AVLC_RIGHT(t, n) = AVLC_LEFT(t, rl);
+    AVLC_RIGHT(t, rl) = r;
+    avlc_set_left(t, rl, n);
+    avlc_set_bal(t, r, AVLC_BAL(t, rl) < 0 ? 1 : 0);
+    avlc_set_bal(t, n, AVLC_BAL(t, rl) > 0 ? -1 : 0);
+    avlc_set_bal(t, rl, 0);
+    return rl;
+}
+
+/* inserts in subtree n, returns its new root. *grown tells whether its height grew */
+static uint32_t avlc_insert_rec(avlc_tree_t * t, uint32_t n, void * data, int * grown) {
+    int bal;
+
+    if (n == 0) {
+        n = t->n_nodes++;
+        t->nodes[n] = (avlc_node_t) { .left_bal = 1U << AVLC_IDX_BITS, .right = 0, .data = data };
+        *grown = 1;
+        return n;
+    }
+    if (t->cmp(data, t->nodes[n].data) <= 0) {
+        uint32_t l = avlc_insert_rec(t, AVLC_LEFT(t, n), data, grown);
+        avlc_set_left(t, n, l);
+        if (*grown) {
+            if ((bal = AVLC_BAL(t, n) - 1) >= -1) {
+                avlc_set_bal(t, n, bal);
+                *grown = (bal != 0);
+            } else {
+                n = avlc_rebalance_left(t, n);
+                *grown = 0;
+            }
+        }
+    } else {
+        uint32_t r = avlc_insert_rec(t, AVLC_RIGHT(t, n), data, grown);
+        AVLC_RIGHT(t, n) = r;
+        if (*grown) {
+            if ((bal = AVLC_BAL(t, n) + 1) <= 1) {
+                avlc_set_bal(t, n, bal);
+                *grown = (bal != 0);
+            } else {
+                n = avlc_rebalance_right(t, n);
+                *grown = 0;
+            }
+        }
+    }
+    return n;
+}
+
+static void * avlc_insert(avlc_tree_t * t, void * data) {
+    int grown;
+
+    if (t->n_nodes >= t->size) {
+        uint32_t        size = t->size ? t->size * 2 : 1024;
+        avlc_node_t *   nodes;
+
+        if (size > AVLC_IDX_MASK || (nodes = realloc(t->nodes, size * sizeof(*nodes))) == NULL) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        t->nodes = nodes;
+        t->size = size;
+    }
+    t->root = avlc_insert_rec(t, t->root, data, &grown);
+    return data;
+}
+
+static void * avlc_find(avlc_tree_t * t, const void * data) {
+    for (uint32_t n = t->root; n != 0; ) {
+        int cmp = t->cmp(data, t->nodes[n].data);
+        if (cmp == 0)
+            return t->nodes[n].data;
+        n = cmp < 0 ? AVLC_LEFT(t, n) : AVLC_RIGHT(t, n);
+    }
+    errno = ENOENT;
+    return NULL;
+}
+
+/* returns the height of subtree n, and counts balance and order errors */
+static unsigned int avlc_check_rec(avlc_tree_t * t, uint32_t n, size_t * nerrors) {
+    unsigned int hl, hr;
+
+    if (n == 0)
+        return 0;
+    hl = avlc_check_rec(t, AVLC_LEFT(t, n), nerrors);
+    hr = avlc_check_rec(t, AVLC_RIGHT(t, n), nerrors);
+    if ((int) hr - (int) hl != AVLC_BAL(t, n)
+    ||  (AVLC_LEFT(t, n) && t->cmp(t->nodes[AVLC_LEFT(t, n)].data, t->nodes[n].data) > 0)
+    ||  (AVLC_RIGHT(t, n) && t->cmp(t->nodes[AVLC_RIGHT(t, n)].data, t->nodes[n].data) < 0)) {
+        ++(*nerrors);
+    }
+    return 1 + (hl > hr ? hl : hr);
+}
+
+static unsigned int avltree_test_compact(const options_test_t * opts, log_t * log) {
+    const size_t    nb_elts[] = { 1000 * 1000, SIZE_MAX, 10 * 1000 * 1000, 0 };
+    unsigned int    nerrors = 0;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    for (const size_t * nb = nb_elts; *nb != 0; nb++) {
+        const unsigned int  seed = time(NULL);
+        avltree_t *         tree;
+        avlc_tree_t *       ctree;
+        size_t              mem, cmem, n_found = 0, n_cfound = 0, n_bad = 0;
+
+        if (*nb == SIZE_MAX) { /* after size max this is only for TEST_bigtree */
+            if ((opts->test_mode & TEST_MASK(TEST_bigtree)) != 0) continue ; else break ;
+        }
+        LOG_INFO(log, "*************************************************");
+        LOG_INFO(log, "*** AVLTREE vs COMPACT AVLTREE (%zu elements)", *nb);
+        if ((tree = avltree_create(AFL_DEFAULT, intcmp, NULL)) == NULL
+        ||  (ctree = avlc_create(intcmp)) == NULL) {
+            LOG_ERROR(log, "error creating trees: %s", strerror(errno));
+            if (tree != NULL)
+                avltree_free(tree);
+            ++nerrors;
+            continue ;
+        }
+
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < *nb; ++i) {
+            void * value = LG(rand() % (*nb * 10));
+            if (avltree_insert(tree, value) != value && errno != 0)
+                ++nerrors;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree insert x %zu | ", *nb);
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < *nb; ++i) {
+            void * value = LG(rand() % (*nb * 10));
+            if (avlc_insert(ctree, value) != value)
+                ++nerrors;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "compact insert x %zu | ", *nb);
+
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < *nb; ++i) {
+            void * value = LG(rand() % (*nb * 10));
+            if (avltree_find(tree, value) == value)
+                ++n_found;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree find x %zu | ", *nb);
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < *nb; ++i) {
+            void * value = LG(rand() % (*nb * 10));
+            if (avlc_find(ctree, value) == value)
+                ++n_cfound;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "compact find x %zu | ", *nb);
+
+        mem = avltree_memorysize(tree);
+        cmem = avlc_memorysize(ctree);
+        LOG_INFO(log, "MEMORYSIZE avltree: %zu (%.03fMB, %.01f bytes/elt), "
+                      "compact: %zu (%.03fMB, %.01f bytes/elt, %zu bytes/node)",
+                 mem, mem / 1000.0 / 1000.0, (double) mem / *nb,
+                 cmem, cmem / 1000.0 / 1000.0, (double) cmem / *nb, sizeof(avlc_node_t));
+
+        avlc_check_rec(ctree, ctree->root, &n_bad);
+        if (n_bad != 0 || n_found != *nb || n_cfound != *nb
+        ||  avlc_count(ctree) != avltree_count(tree)) {
+            LOG_ERROR(log, "error: compact tree: %zu bad nodes, count %zu (expected %zu), "
+                           "found %zu/%zu/%zu", n_bad, avlc_count(ctree), avltree_count(tree),
+                      n_found, n_cfound, *nb);
+            ++nerrors;
+        }
+
+        BENCHS_START(tm_bench, cpu_bench);
+        avltree_free(tree);
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree free x %zu | ", *nb);
+        BENCHS_START(tm_bench, cpu_bench);
+        avlc_free(ctree);
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "compact free x %zu | ", *nb);
+    }
+    return nerrors;
+}
+
+/* ****************************************
+ * Set operations on trees
+ * ***************************************/
+enum {
+    AVLTREE_TEST_SET_UNION = 0,
+    AVLTREE_TEST_SET_INTERSECT,
+    AVLTREE_TEST_SET_DIFFERENCE,
+    AVLTREE_TEST_SET_NB
+};
+
+/* merges sorted arrays without doubles a and b according to op, into out if not NULL.
+ * Returns the number of elements of the result. */
+static size_t avltree_test_set_merge(int op, avltree_cmpfun_t cmp,
+                                     void * const * a, size_t na, void * const * b, size_t nb,
+                                     void ** out) {
+    size_t ia = 0, ib = 0, n = 0;
+
+    while (ia < na && ib < nb) {
+        int c = cmp(a[ia], b[ib]);
+        if (c < 0) {
+            if (op != AVLTREE_TEST_SET_INTERSECT) {
+                if (out != NULL) out[n] = a[ia];
+                ++n;
+            }
+            ++ia;
+        } else if (c > 0) {
+            if (op == AVLTREE_TEST_SET_UNION) {
+                if (out != NULL) out[n] = b[ib];
+                ++n;
+            }
+            ++ib;
+        } else {
+            if (op != AVLTREE_TEST_SET_DIFFERENCE) {
+                if (out != NULL) out[n] = a[ia];
+                ++n;
+            }
+            ++ia;
+            ++ib;
+        }
+    }
+    if (op != AVLTREE_TEST_SET_INTERSECT) {
+        if (out != NULL) memcpy(out + n, a + ia, (na - ia) * sizeof(*a));
+        n += na - ia;
+    }
+    if (op == AVLTREE_TEST_SET_UNION) {
+        if (out != NULL) memcpy(out + n, b + ib, (nb - ib) * sizeof(*b));
+        n += nb - ib;
+    }
+    return n;
+}
+
+/* index of the first element of array >= data */
+static size_t avltree_test_array_lower_bound(avltree_cmpfun_t cmp, void * const * array,
+                                             size_t n, const void * data) {
+    size_t lo = 0, hi = n;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (cmp(array[mid], data) < 0)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+typedef struct {
+    int                 op;
+    avltree_cmpfun_t    cmp;
+    void * const *      a;
+    size_t              na;
+    void * const *      b;
+    size_t              nb;
+    void **             out;
+    size_t              count;
+} avltree_test_set_job_t;
+
+static void * avltree_test_set_job(void * vdata) {
+    avltree_test_set_job_t * job = (avltree_test_set_job_t *) vdata;
+
+    job->count = avltree_test_set_merge(job->op, job->cmp, job->a, job->na, job->b, job->nb,
+                                        job->out);
+    return NULL;
+}
+
+/* parallel avltree_test_set_merge(): a is cut in n_jobs chunks, and b at the same keys
+ * by binary search. Chunks are counted, then merged at their exact output offsets.
+ * Returns the result in *pout, and its number of elements. */
+static size_t avltree_test_set_merge_parallel(int op, avltree_cmpfun_t cmp, unsigned int n_jobs,
+                                              void * const * a, size_t na,
+                                              void * const * b, size_t nb, void *** pout) {
+    avltree_test_set_job_t *    jobs_data;
+    vjob_t **                   jobs;
+    size_t                      total = 0, b_start = 0;
+
+    *pout = NULL;
+    if ((jobs_data = calloc(n_jobs, sizeof(*jobs_data))) == NULL
+    ||  (jobs = calloc(n_jobs, sizeof(*jobs))) == NULL) {
+        if (jobs_data != NULL)
+            free(jobs_data);
+        return 0;
+    }
+    for (unsigned int i = 0; i < n_jobs; ++i) {
+        size_t a_start = (na * i) / n_jobs, a_end = (na * (i + 1)) / n_jobs;
+        size_t b_end = (i + 1 == n_jobs || a_end >= na)
+                       ? nb : avltree_test_array_lower_bound(cmp, b, nb, a[a_end]);
+        jobs_data[i] = (avltree_test_set_job_t) {
+            .op = op, .cmp = cmp, .a = a + a_start, .na = a_end - a_start,
+            .b = b + b_start, .nb = b_end - b_start, .out = NULL };
+        b_start = b_end;
+    }
+    for (unsigned int pass = 0; pass < 2; ++pass) {
+        if (pass == 1) {
+            for (unsigned int i = 0; i < n_jobs; ++i)
+                total += jobs_data[i].count;
+            if (total == 0 || (*pout = malloc(total * sizeof(**pout))) == NULL) {
+                total = 0;
+                break ;
+            }
+            for (size_t i = 0, offset = 0; i < n_jobs; offset += jobs_data[i++].count)
+                jobs_data[i].out = *pout + offset;
+        }
+        for (unsigned int i = 0; i < n_jobs; ++i) {
+            if ((jobs[i] = vjob_run(avltree_test_set_job, &(jobs_data[i]))) == NULL)
+                avltree_test_set_job(&(jobs_data[i]));
+        }
+        for (unsigned int i = 0; i < n_jobs; ++i) {
+            if (jobs[i] != NULL)
+                vjob_waitandfree(jobs[i]);
+        }
+    }
+    free(jobs);
+    free(jobs_data);
+    return total;
+}
+
+/* result of op on a and b by lookups and inserts, element by element */
+static avltree_t * avltree_test_set_reinsert(int op, avltree_t * a, avltree_t * b) {
+    avltree_t * result;
+
+    if (op == AVLTREE_TEST_SET_UNION) {
+        /* union: every element of b not yet in a is inserted in a */
+        AVLTREE_FOREACH_DATA(b, elt, void *, AVH_INFIX) {
+            if (avltree_find(a, elt) == NULL && errno != 0)
+                avltree_insert(a, elt);
+        }
+        return a;
+    }
+    if ((result = avltree_create(AFL_DEFAULT, a->cmp, NULL)) == NULL)
+        return NULL;
+    AVLTREE_FOREACH_DATA(a, elt, void *, AVH_INFIX) {
+        int in_b = (avltree_find(b, elt) != NULL || errno == 0);
+        if (in_b == (op == AVLTREE_TEST_SET_INTERSECT))
+            avltree_insert(result, elt);
+    }
+    return result;
+}
+
+static unsigned int avltree_test_setops(const options_test_t * opts, log_t * log) {
+    const size_t        nb_elts[] = { 1000 * 1000, SIZE_MAX, 10 * 1000 * 1000, 0 };
+    static const char * ops[] = { "union", "intersect", "difference" };
+    const unsigned int  n_cpus = vjob_cpu_nb() > 0 ? vjob_cpu_nb() : 1;
+    unsigned int        nerrors = 0;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    for (const size_t * nb = nb_elts; *nb != 0; nb++) {
+        /* a holds multiples of 2, b multiples of 3, both inserted in scattered order */
+        const size_t    n_expected[] = { *nb + *nb - (2 * *nb + 5) / 6, (2 * *nb + 5) / 6,
+                                         *nb - (2 * *nb + 5) / 6 };
+
+        if (*nb == SIZE_MAX) { /* after size max this is only for TEST_bigtree */
+            if ((opts->test_mode & TEST_MASK(TEST_bigtree)) != 0) continue ; else break ;
+        }
+        LOG_INFO(log, "*************************************************");
+        LOG_INFO(log, "*** SET OPERATIONS on trees (2 x %zu elements)", *nb);
+
+        for (int op = 0; op < AVLTREE_TEST_SET_NB; ++op) {
+            avltree_t * trees[2] = { NULL, NULL }, * result = NULL;
+            void **     arrays[2] = { NULL, NULL }, ** out = NULL;
+            size_t      n_arrays[2] = { 0, 0 }, n_out;
+
+            for (unsigned int i = 0; i < 2; ++i) {
+                if ((trees[i] = avltree_create(AFL_DEFAULT, intcmp, NULL)) == NULL) {
+                    ++nerrors;
+                    continue ;
+                }
+                for (size_t j = 0; j < *nb; ++j) {
+                    void * value = LG((long) (2 + i) * (long) ((j * 2654435761UL) % *nb));
+                    if (avltree_insert(trees[i], value) != value && errno != 0)
+                        ++nerrors;
+                }
+            }
+            if (trees[0] == NULL || trees[1] == NULL) {
+                LOG_ERROR(log, "error creating trees: %s", strerror(errno));
+                for (unsigned int i = 0; i < 2; ++i)
+                    if (trees[i] != NULL) avltree_free(trees[i]);
+                continue ;
+            }
+
+            /* merge based: to_array, merge, load sorted */
+            BENCHS_START(tm_bench, cpu_bench);
+            for (unsigned int i = 0; i < 2; ++i)
+                n_arrays[i] = avltree_to_array(trees[i], AVH_INFIX, &arrays[i]);
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: avltree_to_array x 2 | ", ops[op]);
+
+            BENCHS_START(tm_bench, cpu_bench);
+            n_out = avltree_test_set_merge(op, intcmp, arrays[0], n_arrays[0],
+                                           arrays[1], n_arrays[1], NULL);
+            if ((out = malloc((n_out ? n_out : 1) * sizeof(*out))) != NULL)
+                avltree_test_set_merge(op, intcmp, arrays[0], n_arrays[0],
+                                       arrays[1], n_arrays[1], out);
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: merge -> %zu | ", ops[op], n_out);
+            if (out != NULL)
+                free(out);
+
+            BENCHS_START(tm_bench, cpu_bench);
+            n_out = avltree_test_set_merge_parallel(op, intcmp, n_cpus, arrays[0], n_arrays[0],
+                                                    arrays[1], n_arrays[1], &out);
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: parallel merge (%u jobs) -> %zu | ",
+                            ops[op], n_cpus, n_out);
+
+            if ((result = avltree_create(AFL_DEFAULT, intcmp, NULL)) != NULL) {
+                BENCHS_START(tm_bench, cpu_bench);
+                if (avltree_test_load_sorted_array(result, out, n_out) != 0)
+                    ++nerrors;
+                BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: avltree_test_load_sorted x %zu | ",
+                                ops[op], n_out);
+                if (avltree_count(result) != n_expected[op]
+                ||  avlprint_rec_check_balance(result->root, log) != 0) {
+                    LOG_ERROR(log, "error: merge %s: %zu elements, expected %zu",
+                              ops[op], avltree_count(result), n_expected[op]);
+                    ++nerrors;
+                }
+                avltree_free(result);
+            }
+            if (out != NULL)
+                free(out);
+            for (unsigned int i = 0; i < 2; ++i) {
+                if (arrays[i] != NULL)
+                    free(arrays[i]);
+            }
+
+            /* reference: lookups and inserts element by element */
+            BENCHS_START(tm_bench, cpu_bench);
+            result = avltree_test_set_reinsert(op, trees[0], trees[1]);
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s: find+insert -> %zu | ",
+                            ops[op], result ? avltree_count(result) : 0);
+            if (result == NULL || avltree_count(result) != n_expected[op]) {
+                LOG_ERROR(log, "error: find+insert %s: %zu elements, expected %zu",
+                          ops[op], result ? avltree_count(result) : 0, n_expected[op]);
+                ++nerrors;
+            }
+            if (result != NULL && result != trees[0])
+                avltree_free(result);
+            avltree_free(trees[0]);
+            avltree_free(trees[1]);
+        }
+    }
+    return nerrors;
+}
+
+/* ****************************************
+ * Parallel construction from unsorted data
+ * ***************************************/
+typedef struct {
+    avltree_cmpfun_t    cmp;
+    void **             src;
+    void **             dst;
+    size_t              start;
+    size_t              mid;
+    size_t              end;
+} avltree_test_build_job_t;
+
+/* stable merge of src[start,mid[ and src[mid,end[ into dst[start,end[ */
+static void avltree_test_build_merge(avltree_cmpfun_t cmp, void ** src, void ** dst,
+                                     size_t start, size_t mid, size_t end) {
+    size_t i = start, j = mid, k = start;
+
+    while (i < mid && j < end)
+        dst[k++] = cmp(src[j], src[i]) < 0 ? src[j++] : src[i++];
+    memcpy(dst + k, src + i, (mid - i) * sizeof(*dst));
+    k += mid - i;
+    memcpy(dst + k, src + j, (end - j) * sizeof(*dst));
+}
+
+/* sorts src[start,end[ with a stable bottom-up merge sort, using dst as buffer */
+static void * avltree_test_build_sort_job(void * vdata) {
+    avltree_test_build_job_t *  job = (avltree_test_build_job_t *) vdata;
+    void **                     src = job->src, ** dst = job->dst, ** tmp;
+    const size_t                run = 32;
+
+    for (size_t i = job->start; i < job->end; i += run) {
+        size_t end = i + run < job->end ? i + run : job->end;
+        for (size_t j = i + 1; j < end; ++j) {
+            void * data = src[j];
+            size_t k = j;
+            for ( ; k > i && job->cmp(data, src[k - 1]) < 0; --k)
+                src[k] = src[k - 1];
+            src[k] = data;
+        }
+    }
+    for (size_t width = run; width < job->end - job->start; width *= 2) {
+        for (size_t i = job->start; i < job->end; i += 2 * width) {
+            size_t mid = i + width < job->end ? i + width : job->end;
+            size_t end = mid + width < job->end ? mid + width : job->end;
+            avltree_test_build_merge(job->cmp, src, dst, i, mid, end);
+        }
+        tmp = src; src = dst; dst = tmp;
+    }
+    if (src != job->src)
+        memcpy(job->src + job->start, src + job->start,
+               (job->end - job->start) * sizeof(*src));
+    return NULL;
+}
+
+static void * avltree_test_build_merge_job(void * vdata) {
+    avltree_test_build_job_t * job = (avltree_test_build_job_t *) vdata;
+
+    avltree_test_build_merge(job->cmp, job->src, job->dst, job->start, job->mid, job->end);
+    return NULL;
+}
+
+/* runs jobs on vjobs, or in the current thread if vjob_run() fails */
+static void avltree_test_build_run(void * (*fun)(void *), avltree_test_build_job_t * jobs_data,
+                                   vjob_t ** jobs, unsigned int n_jobs) {
+    for (unsigned int i = 0; i < n_jobs; ++i) {
+        if ((jobs[i] = vjob_run(fun, &(jobs_data[i]))) == NULL)
+            fun(&(jobs_data[i]));
+    }
+    for (unsigned int i = 0; i < n_jobs; ++i) {
+        if (jobs[i] != NULL)
+            vjob_waitandfree(jobs[i]);
+    }
+}
+
+/* Sorts a copy of array with n_jobs jobs: chunks are sorted in parallel, then
+ * merged two by two in parallel. Doubles are then dropped according to flags
+ * AFL_INSERT_NODOUBLE/IGNDOUBLE (first kept) or AFL_INSERT_REPLACE (last kept).
+ * Returns the sorted array to be freed, with its number of elements in *n_out. */
+static void ** avltree_test_sort_parallel(avltree_cmpfun_t cmp, unsigned int flags,
+                                          void * const * array, size_t n, unsigned int n_jobs,
+                                          size_t * n_out, log_t * log) {
+    void **                     src, ** dst, ** tmp;
+    avltree_test_build_job_t *  jobs_data;
+    vjob_t **                   jobs;
+    size_t *                    bounds;
+    unsigned int                n_runs = n_jobs;
+    BENCH_TM_DECL(tm_bench);
+
+    *n_out = 0;
+    src = malloc((n ? n : 1) * sizeof(*src));
+    dst = malloc((n ? n : 1) * sizeof(*dst));
+    jobs_data = calloc(n_jobs, sizeof(*jobs_data));
+    jobs = calloc(n_jobs, sizeof(*jobs));
+    bounds = calloc(n_jobs + 1, sizeof(*bounds));
+    if (src == NULL || dst == NULL || jobs_data == NULL || jobs == NULL || bounds == NULL) {
+        if (src) free(src);
+        if (dst) free(dst);
+        if (jobs_data) free(jobs_data);
+        if (jobs) free(jobs);
+        if (bounds) free(bounds);
+        return NULL;
+    }
+    memcpy(src, array, n * sizeof(*src));
+
+    /* sort chunks */
+    BENCH_TM_START(tm_bench);
+    for (unsigned int i = 0; i <= n_jobs; ++i)
+        bounds[i] = (n * i) / n_jobs;
+    for (unsigned int i = 0; i < n_jobs; ++i) {
+        jobs_data[i] = (avltree_test_build_job_t) { .cmp = cmp, .src = src, .dst = dst,
+                                                    .start = bounds[i], .end = bounds[i + 1] };
+    }
+    avltree_test_build_run(avltree_test_build_sort_job, jobs_data, jobs, n_jobs);
+    BENCH_TM_STOP(tm_bench);
+    LOG_VERBOSE(log, "parallel sort(%u jobs): chunks sorted in %ld ms", n_jobs,
+                BENCH_TM_GET(tm_bench));
+
+    /* merge sorted runs two by two */
+    BENCH_TM_START(tm_bench);
+    while (n_runs > 1) {
+        unsigned int n_merges = n_runs / 2;
+        for (unsigned int i = 0; i < n_merges; ++i) {
+            jobs_data[i] = (avltree_test_build_job_t) { .cmp = cmp, .src = src, .dst = dst,
+                .start = bounds[2 * i], .mid = bounds[2 * i + 1], .end = bounds[2 * i + 2] };
+        }
+        avltree_test_build_run(avltree_test_build_merge_job, jobs_data, jobs, n_merges);
+        if ((n_runs & 1) != 0) {
+            memcpy(dst + bounds[n_runs - 1], src + bounds[n_runs - 1],
+                   (bounds[n_runs] - bounds[n_runs - 1]) * sizeof(*dst));
+        }
+        for (unsigned int i = 0; i <= n_runs; i += 2)
+            bounds[i / 2] = bounds[i];
+        if ((n_runs & 1) != 0)
+            bounds[n_merges + 1] = bounds[n_runs];
+        n_runs = n_merges + (n_runs & 1);
+        tmp = src; src = dst; dst = tmp;
+    }
+    BENCH_TM_STOP(tm_bench);
+    LOG_VERBOSE(log, "parallel sort(%u jobs): runs merged in %ld ms", n_jobs,
+                BENCH_TM_GET(tm_bench));
+
+    /* doubles */
+    *n_out = n;
+    if ((flags & (AFL_INSERT_NODOUBLE | AFL_INSERT_IGNDOUBLE | AFL_INSERT_REPLACE)) != 0
+    &&  n > 0) {
+        int     keep_last = (flags & AFL_INSERT_REPLACE) != 0;
+        size_t  j = 0;
+        for (size_t i = 1; i < n; ++i) {
+            if (cmp(src[i], src[j]) != 0)
+                src[++j] = src[i];
+            else if (keep_last)
+                src[j] = src[i];
+        }
+        *n_out = j + 1;
+    }
+
+    free(dst);
+    free(jobs_data);
+    free(jobs);
+    free(bounds);
+    return src;
+}
+
+/* fills an empty tree with the n unsorted elements of array, using n_jobs jobs.
+ * Returns the number of errors. */
+static size_t avltree_test_build_parallel(avltree_t * tree, void * const * array, size_t n,
+                                          unsigned int n_jobs, log_t * log) {
+    size_t  n_sorted, nerrors;
+    void ** sorted = avltree_test_sort_parallel(tree->cmp, tree->flags, array, n, n_jobs,
+                                                &n_sorted, log);
+
+    if (sorted == NULL)
+        return n;
+    nerrors = avltree_test_load_sorted_array(tree, sorted, n_sorted);
+    free(sorted);
+    return nerrors;
+}
+
+static unsigned int avltree_test_parallel_build(const options_test_t * opts, log_t * log) {
+    const size_t        nb_elts[] = { 1000 * 1000, SIZE_MAX, 100 * 1000 * 1000, 0 };
+    const unsigned int  n_cpus = vjob_cpu_nb() > 0 ? vjob_cpu_nb() : 1;
+    unsigned int        nerrors = 0;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    for (const size_t * nb = nb_elts; *nb != 0; nb++) {
+        void **     array, ** sorted;
+        avltree_t * tree;
+        size_t      n_sorted, n_distinct = 0;
+
+        if (*nb == SIZE_MAX) { /* after size max this is only for TEST_bigtree */
+            if ((opts->test_mode & TEST_MASK(TEST_bigtree)) != 0) continue ; else break ;
+        }
+        LOG_INFO(log, "*************************************************");
+        LOG_INFO(log, "*** PARALLEL TREE CONSTRUCTION (%zu unsorted elements)", *nb);
+        if ((array = malloc(*nb * sizeof(*array))) == NULL) {
+            LOG_ERROR(log, "error: cannot allocate array(%zu)", *nb);
+            ++nerrors;
+            continue ;
+        }
+        for (size_t i = 0; i < *nb; ++i)
+            array[i] = LG(rand() % (*nb * 10));
+
+        /* reference: one avltree_insert() per element */
+        if ((tree = avltree_create(AFL_DEFAULT, intcmp, NULL)) != NULL) {
+            BENCHS_START(tm_bench, cpu_bench);
+            for (size_t i = 0; i < *nb; ++i) {
+                if (avltree_insert(tree, array[i]) != array[i] && errno != 0)
+                    ++nerrors;
+            }
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree_insert() x %zu | ", *nb);
+            avltree_free(tree);
+        }
+
+        /* sort + merge scaling, 1, 2, 4, ..., n_cpus jobs */
+        for (unsigned int n_jobs = 1, last = 0; !last;
+                last = (n_jobs >= n_cpus),
+                n_jobs = (n_jobs * 2 > n_cpus ? n_cpus : n_jobs * 2)) {
+            BENCHS_START(tm_bench, cpu_bench);
+            sorted = avltree_test_sort_parallel(intcmp, AFL_DEFAULT, array, *nb, n_jobs,
+                                                &n_sorted, log);
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "parallel sort (%u jobs) x %zu | ",
+                            n_jobs, *nb);
+            for (size_t i = 1; sorted != NULL && i < n_sorted; ++i) {
+                if ((long) sorted[i - 1] > (long) sorted[i]) {
+                    ++nerrors;
+                    break ;
+                }
+            }
+            if (sorted == NULL || n_sorted != *nb) {
+                LOG_ERROR(log, "error: parallel sort (%u jobs): %zu elements (expected %zu)",
+                          n_jobs, n_sorted, *nb);
+                ++nerrors;
+            } else if (n_jobs == 1) {
+                /* reference for the build without doubles */
+                n_distinct = n_sorted > 0;
+                for (size_t i = 1; i < n_sorted; ++i) {
+                    if (sorted[i - 1] != sorted[i])
+                        ++n_distinct;
+                }
+            }
+            if (sorted != NULL)
+                free(sorted);
+        }
+
+        /* full build, with and without doubles */
+        for (unsigned int i_flags = 0; i_flags < 2; ++i_flags) {
+            unsigned int flags = i_flags == 0 ? AFL_DEFAULT
+                                 : (AFL_DEFAULT & ~AFL_INSERT_MASK) | AFL_INSERT_IGNDOUBLE;
+            if ((tree = avltree_create(flags, intcmp, NULL)) == NULL) {
+                ++nerrors;
+                continue ;
+            }
+            BENCHS_START(tm_bench, cpu_bench);
+            if (avltree_test_build_parallel(tree, array, *nb, n_cpus, log) != 0)
+                ++nerrors;
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "avltree_test_build_parallel(%s, "
+                            "%u jobs) x %zu -> %zu | ", i_flags == 0 ? "doubles" : "no doubles",
+                            n_cpus, *nb, avltree_count(tree));
+            if (avltree_count(tree) != (i_flags == 0 ? *nb : n_distinct)
+            ||  avlprint_rec_check_balance(tree->root, log) != 0) {
+                LOG_ERROR(log, "error: avltree_test_build_parallel(%s): %zu elements "
+                               "(expected %zu)", i_flags == 0 ? "doubles" : "no doubles",
+                          avltree_count(tree), i_flags == 0 ? *nb : n_distinct);
+                ++nerrors;
+            }
+            avltree_free(tree);
+        }
+        free(array);
+    }
+    return nerrors;
+}
+
 void * test_avltree(void * vdata) {
     const options_test_t * opts = (const options_test_t *) vdata;
     testgroup_t *   test = TEST_START(opts->testpool, "AVLTREE");
@@ -1182,6 +3641,7 @@ void * test_avltree(void * vdata) {
         size_t len;
         avltree_iterator_t * iterator;
         avltree_visit_context_t * context;
+        avltree_node_info_t node_infos;
         
         if (*nb == SIZE_MAX) { /* after size max this is only for TEST_bigtree */
             if ((opts->test_mode & TEST_MASK(TEST_bigtree)) != 0) continue ; else break ;
@@ -1247,6 +3707,9 @@ void * test_avltree(void * vdata) {
         if (progress_max && log->level >= LOG_LVL_INFO)
             fputc('\n', log->out);
         BENCHS_STOP_LOG(tm_bench, bench, log, "creation of %zu nodes ", *nb);
+        LOG_INFO(log, "insert throughput: %.0f elts/s",
+                 BENCH_TM_GET_US(tm_bench) > 0
+                 ? (double) *nb * 1000000.0 / BENCH_TM_GET_US(tm_bench) : 0.0);
 
         /* visit */
         LOG_INFO(log, "* checking balance, prefix, infix, infix_r, "
@@ -1384,6 +3847,10 @@ void * test_avltree(void * vdata) {
         n = avltree_memorysize(tree);
         BENCH_STOP_LOG(bench, log, "MEMORYSIZE (%zu nodes) = %d (%.03fMB) | ",
                        *nb, n, n / 1000.0 / 1000.0);
+        avltree_node_infos(&node_infos);
+        LOG_INFO(log, "MEMORYSIZE: %.01f bytes/elt, for nodes of %zu bytes",
+                 avltree_count(tree) ? (double) n / avltree_count(tree) : 0.0,
+                 node_infos.node_size);
 
         /* visit range */
         rbuf_reset(all_results);
@@ -1655,6 +4122,10 @@ void * test_avltree(void * vdata) {
         BENCHS_START(tm_bench, bench);
         avltree_free(tree);
         BENCHS_STOP_LOG(tm_bench, bench, log, "freed %zd nodes | ", *nb - total_remove);
+        LOG_INFO(log, "free throughput: %.0f elts/s",
+                 BENCH_TM_GET_US(tm_bench) > 0
+                 ? (double) (*nb - total_remove) * 1000000.0 / BENCH_TM_GET_US(tm_bench)
+                 : 0.0);
     }
 
     /* ****************************************
@@ -1749,6 +4220,36 @@ void * test_avltree(void * vdata) {
     avltree_free(tree2);
     avltree_free(tree);
 
+    /* Trees loaded from sorted data */
+    nerrors += avltree_test_sorted(opts, log);
+
+    /* node pool with a free list, compared with malloc */
+    nerrors += avltree_test_node_pool(opts, log);
+
+    /* B+-tree comparison: point lookups and range scans */
+    nerrors += avltree_test_bptree(opts, log);
+
+    /* parallel visits: vlib's and work-stealing, on several tree shapes */
+    nerrors += avltree_test_ws_visit(opts, log);
+
+    /* concurrent readers and writers */
+    nerrors += avltree_test_concurrent(opts, log);
+
+    /* rank, select, count_range and to_array with exact offsets */
+    nerrors += avltree_test_order_stats(opts, log);
+
+    /* iterators without heap allocation */
+    nerrors += avltree_test_inline_iterator(log);
+
+    /* compact layout with 32-bit indices */
+    nerrors += avltree_test_compact(opts, log);
+
+    /* set operations: element by element vs merge of sorted arrays */
+    nerrors += avltree_test_setops(opts, log);
+
+    /* parallel construction from unsorted data */
+    nerrors += avltree_test_parallel_build(opts, log);
+
     /* END */
     rbuf_free(two_results);
     rbuf_free(all_results);
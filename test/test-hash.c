@@ -28,6 +28,9 @@
 #ifndef _TEST
 extern int ___nothing___; /* empty */
 #else
+#include <string.h>
+#include <time.h>
+
 #include "vlib/hash.h"
 #include "vlib/test.h"
 #include "vlib/options.h"
@@ -57,17 +60,747 @@ static int hash_print_stats(hash_t * hash, FILE * file) {
                        " elements   : %u\n"
                        " indexes    : %u\n"
                        " index_coll : %u\n"
-                       " collisions : %u\n",
+                       " collisions : %u\n"
+                       " load       : %.03f\n"
+                       " avg_chain  : %.03f\n",
                        (void*) hash,
                        stats.hash_size, stats.hash_flags,
                        stats.n_elements, stats.n_indexes,
-                       stats.n_indexes_with_collision, stats.n_collisions)) < 0) {
+                       stats.n_indexes_with_collision, stats.n_collisions,
+                       stats.hash_size == 0 ? 0.0 : (double) stats.n_elements / stats.hash_size,
+                       stats.n_indexes == 0 ? 0.0 : (double) stats.n_elements / stats.n_indexes)) < 0) {
         return -1;
     }
     n += tmp;
     return n;
 }
 
+/* Candidate string hash for long keys: reads 16 bytes per step in two independent
+ * 64-bit lanes, then 8 bytes, then the tail. hash_test_strw_seeded() takes the
+ * seed explicitly; hash_test_strw() is the hash_t callback using
+ * HASH_TEST_STRW_SEED. */
+#define HASH_TEST_STRW_SEED      UINT64_C(0x9e3779b97f4a7c15)
+
+#define HASH_TEST_STRW_K1        UINT64_C(0x87c37b91114253d5)
+#define HASH_TEST_STRW_K2        UINT64_C(0x4cf5ad432745937f)
+#define HASH_TEST_STRW_ROTL(x,r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+static inline uint64_t hash_test_strw_round(uint64_t acc, uint64_t word) {
+    word *= HASH_TEST_STRW_K1;
+    word = HASH_TEST_STRW_ROTL(word, 31);
+    word *= HASH_TEST_STRW_K2;
+    acc ^= word;
+    return HASH_TEST_STRW_ROTL(acc, 27) * 5 + 0x52dce729;
+}
+
+static unsigned int hash_test_strw_seeded(const void * key, uint64_t seed) {
+    const unsigned char *   str = (const unsigned char *) key;
+    size_t                  len = strlen((const char *) key);
+    uint64_t                h1 = seed ^ (len * HASH_TEST_STRW_K1);
+    uint64_t                h2 = seed * HASH_TEST_STRW_K2; /* seed ^ K2 cancels in h1 ^ h2 */
+    uint64_t                w1, w2;
+
+    for ( ; len >= 16; len -= 16, str += 16) {
+        memcpy(&w1, str, sizeof(w1));
+        memcpy(&w2, str + 8, sizeof(w2));
+        h1 = hash_test_strw_round(h1, w1);
+        h2 = hash_test_strw_round(h2, w2);
+    }
+    if (len >= 8) {
+        memcpy(&w1, str, sizeof(w1));
+        h1 = hash_test_strw_round(h1, w1);
+        len -= 8;
+        str += 8;
+    }
+    for (w2 = 0; len > 0; --len) {
+        w2 = (w2 << 8) | str[len - 1];
+    }
+    h1 = hash_test_strw_round(h1 ^ h2, w2);
+    /* final avalanche (murmur3 fmix64) */
+    h1 ^= h1 >> 33;
+    h1 *= UINT64_C(0xff51afd7ed558ccd);
+    h1 ^= h1 >> 33;
+    h1 *= UINT64_C(0xc4ceb9fe1a85ec53);
+    h1 ^= h1 >> 33;
+    return (unsigned int) (h1 ^ (h1 >> 32));
+}
+
+static unsigned int hash_test_strw(hash_t * hash, const void * key) {
+    (void) hash;
+    return hash_test_strw_seeded(key, HASH_TEST_STRW_SEED);
+}
+
+/* known answers, seed dependency and spread of hash_test_strw() */
+static void test_hash_strw_check(const char * const * strs, testgroup_t * test) {
+    log_t *                 log = test != NULL ? test->log : NULL;
+    /* keys of 8 bytes or more are read as native words: checked on little-endian only */
+    static const struct {
+        const char *    key;
+        unsigned int    hash;
+        int             word_read;
+    } known[] = {
+        { "",                                       0x6642b579, 0 },
+        { "abc",                                    0x99fc393d, 0 },
+        { "vsensorsdemo",                           0x6ef07bdc, 1 },
+        { "0123456789abcdefghijklmnopqrstuvwxyz",   0xeec491c5, 1 },
+    };
+    const uint16_t          endian = 1;
+    const int               little = *((const unsigned char *) &endian) == 1;
+    const unsigned int      n_keys = 10000, n_buckets = 1024;
+    unsigned int *          chains;
+    unsigned int            max_chain = 0, n_errors = 0;
+    char                    key[64];
+
+    for (unsigned int i = 0; i < PTR_COUNT(known); ++i) {
+        unsigned int h = hash_test_strw(NULL, known[i].key);
+        if (known[i].word_read && !little)
+            continue ;
+        TEST_CHECK2(test, "hash_test_strw(\"%s\") = %08x, expected %08x",
+                    h == known[i].hash, known[i].key, h, known[i].hash);
+    }
+    for (const char * const * str = strs; *str != NULL; ++str) {
+        if (hash_test_strw_seeded(*str, HASH_TEST_STRW_SEED)
+        ==  hash_test_strw_seeded(*str, HASH_TEST_STRW_SEED ^ 1))
+            ++n_errors;
+        for (const char * const * other = strs; other != str; ++other) {
+            if (hash_test_strw(NULL, *str) == hash_test_strw(NULL, *other))
+                ++n_errors;
+        }
+    }
+    TEST_CHECK2(test, "hash_test_strw seeds and collisions: %u errors", n_errors == 0, n_errors);
+
+    /* generated keys of 1 to 63 chars, spread over buckets */
+    if ((chains = calloc(n_buckets, sizeof(*chains))) == NULL) {
+        TEST_CHECK(test, "hash_test_strw chains calloc", 0);
+        return ;
+    }
+    for (unsigned int i = 0; i < n_keys; ++i) {
+        unsigned int * chain;
+        snprintf(key, sizeof(key), "%0*u", (int) (i % (sizeof(key) - 1)), i);
+        chain = &chains[hash_test_strw(NULL, key) % n_buckets];
+        if (++(*chain) > max_chain)
+            max_chain = *chain;
+    }
+    free(chains);
+    LOG_INFO(log, "hash_test_strw: %u keys in %u buckets, max chain %u (mean %.1f)",
+             n_keys, n_buckets, max_chain, (double) n_keys / n_buckets);
+    TEST_CHECK2(test, "hash_test_strw max chain %u <= %u", max_chain <= 4 * n_keys / n_buckets,
+                max_chain, 4 * n_keys / n_buckets);
+}
+
+static void test_hash_str_bench(testgroup_t * test) {
+    log_t *                 log = test != NULL ? test->log : NULL;
+    static const size_t     key_lens[] = { 4, 16, 64, 256, 1024, 4096 };
+    const size_t            bytes_per_len = 8 * 1024 * 1024;
+    static const struct {
+        const char *    name;
+        unsigned int    (*fun)(hash_t *, const void *);
+    } funs[] = { { "hash_str", hash_str }, { "hash_test_strw", hash_test_strw } };
+    char *                  key;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    if ((key = malloc(key_lens[PTR_COUNT(key_lens) - 1] + 1)) == NULL) {
+        TEST_CHECK(test, "hash_str bench malloc", 0);
+        return ;
+    }
+    for (unsigned int i_len = 0; i_len < PTR_COUNT(key_lens); ++i_len) {
+        size_t len = key_lens[i_len];
+        size_t n_loops = bytes_per_len / len;
+
+        for (size_t i = 0; i < len; ++i) {
+            key[i] = 'a' + (i * 7) % 26;
+        }
+        key[len] = 0;
+        for (unsigned int i_fun = 0; i_fun < PTR_COUNT(funs); ++i_fun) {
+            unsigned int acc = 0;
+
+            BENCHS_START(tm_bench, cpu_bench);
+            for (size_t i = 0; i < n_loops; ++i) {
+                key[i % len] ^= 1; /* defeat hoisting of the loop-invariant hash call */
+                acc ^= funs[i_fun].fun(NULL, key);
+            }
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "%s(len=%zu) x %zu (acc %08x) | ",
+                            funs[i_fun].name, len, n_loops, acc);
+        }
+    }
+    free(key);
+}
+
+/* Pointer hash of the hash models below, whose keys are small integers:
+ * first steps of murmur3 fmix64, so that nearby keys spread over the buckets. */
+static inline unsigned int test_hash_ptr_mix(const void * key) {
+    uint64_t h = (uint64_t) (uintptr_t) key;
+
+    h ^= h >> 33;
+    h *= UINT64_C(0xff51afd7ed558ccd);
+    h ^= h >> 33;
+    return (unsigned int) h;
+}
+
+/* Open-addressing model compared head-to-head with hash_t on the bighash keys:
+ * Robin Hood linear probing, with keys and hashes stored inline in the slots.
+ * An insert takes the slot of any entry closer to its home than itself, which
+ * keeps probe lengths short; a find stops as soon as it meets such an entry. */
+typedef struct {
+    const void *    key;
+    unsigned int    hash;
+    unsigned int    dist;       /* probe distance + 1, 0 when the slot is free */
+} test_oahash_slot_t;
+
+typedef struct {
+    test_oahash_slot_t *    slots;
+    size_t                  mask;
+    size_t                  n_elements;
+    unsigned int            max_dist;
+} test_oahash_t;
+
+/* capacity is the smallest power of two keeping the load factor under 7/8 */
+static int test_oahash_init(test_oahash_t * oa, size_t nb) {
+    size_t size = 16;
+
+    while (size - size / 8 < nb)
+        size <<= 1;
+    oa->mask = size - 1;
+    oa->n_elements = 0;
+    oa->max_dist = 0;
+    return (oa->slots = calloc(size, sizeof(*oa->slots))) == NULL ? -1 : 0;
+}
+
+static int test_oahash_insert(test_oahash_t * oa, const void * key) {
+    test_oahash_slot_t  cur = { key, test_hash_ptr_mix(key), 1 };
+
+    if (oa->n_elements + 1 > oa->mask + 1 - (oa->mask + 1) / 8)
+        return -1;
+    for (size_t i = cur.hash & oa->mask; ; i = (i + 1) & oa->mask, ++cur.dist) {
+        test_oahash_slot_t * slot = &(oa->slots[i]);
+
+        if (cur.dist > oa->max_dist)
+            oa->max_dist = cur.dist;
+        if (slot->dist == 0) {
+            *slot = cur;
+            ++oa->n_elements;
+            return 0;
+        }
+        if (slot->dist < cur.dist) {
+            test_oahash_slot_t tmp = *slot;
+            *slot = cur;
+            cur = tmp;
+        }
+    }
+}
+
+static const void * test_oahash_find(const test_oahash_t * oa, const void * key) {
+    unsigned int hash = test_hash_ptr_mix(key);
+
+    for (size_t i = hash & oa->mask, dist = 1; ; i = (i + 1) & oa->mask, ++dist) {
+        const test_oahash_slot_t * slot = &(oa->slots[i]);
+
+        if (slot->dist < dist)
+            return NULL;
+        if (slot->hash == hash && slot->key == key)
+            return slot->key;
+    }
+}
+
+static void test_oahash_bench(testgroup_t * test, size_t nb, unsigned int seed) {
+    log_t *         log = test != NULL ? test->log : NULL;
+    const char *    name = "robinhood";
+    test_oahash_t   oa;
+    size_t          n_found = 0, n_errors = 0;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    TEST_CHECK2(test, "big hash_alloc(%s, nb=%zu) not NULL",
+                test_oahash_init(&oa, nb) == 0, name, nb);
+    if (oa.slots == NULL) {
+        return ;
+    }
+
+    srand(seed);
+    BENCHS_START(tm_bench, cpu_bench);
+    for (size_t i = 0; i < nb; ++i) {
+        void * value = (void*)(((size_t)rand()) % (nb * 10UL));
+        if (test_oahash_insert(&oa, value) != 0) {
+            ++n_errors;
+        }
+    }
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "big hash_inserts(%s,sz=%zu,nb=%zu)",
+                    name, oa.mask + 1, nb);
+    TEST_CHECK2(test, "big hash_inserts(%s,nb=%zu): %zu errors", n_errors == 0,
+                name, nb, n_errors);
+    LOG_VERBOSE(log, "Hash %s: size %zu, elements %zu, load %.03f, max_probe %u",
+                name, oa.mask + 1, oa.n_elements,
+                (double) oa.n_elements / (oa.mask + 1), oa.max_dist);
+
+    /* replay the same keys: every lookup must succeed */
+    srand(seed);
+    BENCHS_START(tm_bench, cpu_bench);
+    for (size_t i = 0; i < nb; ++i) {
+        void * value = (void*)(((size_t)rand()) % (nb * 10UL));
+        if (test_oahash_find(&oa, value) == value) {
+            ++n_found;
+        }
+    }
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "big hash_finds(%s,sz=%zu,nb=%zu)",
+                    name, oa.mask + 1, nb);
+    TEST_CHECK2(test, "big hash_find(%s,sz=%zu): %zu/%zu found", n_found == nb,
+                name, oa.mask + 1, n_found, nb);
+
+    BENCHS_START(tm_bench, cpu_bench);
+    free(oa.slots);
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "big hash_free(%s,sz=%zu, nb=%zu)",
+                    name, oa.mask + 1, nb);
+}
+
+/* Thread-safe hash built on hash_t by lock striping: keys are spread over
+ * n_stripes independent tables, each protected by its own mutex.
+ * With n_stripes == 1, this is the usual 'hash_t + global mutex'. */
+typedef struct {
+    unsigned int        n_stripes;
+    hash_t **           hashs;
+    pthread_mutex_t *   locks;
+} test_shash_t;
+
+static void test_shash_free(test_shash_t * shash) {
+    if (shash == NULL)
+        return ;
+    for (unsigned int i = 0; i < shash->n_stripes; ++i) {
+        if (shash->hashs[i] != NULL) {
+            hash_free(shash->hashs[i]);
+            pthread_mutex_destroy(&(shash->locks[i]));
+        }
+    }
+    free(shash->hashs);
+    free(shash->locks);
+    free(shash);
+}
+
+static test_shash_t * test_shash_create(unsigned int n_stripes, unsigned int size,
+                                        unsigned int flags) {
+    test_shash_t * shash;
+
+    if (n_stripes == 0 || (shash = calloc(1, sizeof(*shash))) == NULL) {
+        return NULL;
+    }
+    shash->n_stripes = n_stripes;
+    if ((shash->hashs = calloc(n_stripes, sizeof(*shash->hashs))) == NULL
+    ||  (shash->locks = calloc(n_stripes, sizeof(*shash->locks))) == NULL) {
+        shash->n_stripes = 0;
+        test_shash_free(shash);
+        return NULL;
+    }
+    size = size / n_stripes > 0 ? size / n_stripes : 1;
+    for (unsigned int i = 0; i < n_stripes; ++i) {
+        if (pthread_mutex_init(&(shash->locks[i]), NULL) != 0) {
+            shash->n_stripes = i;
+            test_shash_free(shash);
+            return NULL;
+        }
+        if ((shash->hashs[i] = hash_alloc(size, flags, hash_ptr, hash_ptrcmp, NULL)) == NULL) {
+            pthread_mutex_destroy(&(shash->locks[i]));
+            shash->n_stripes = i;
+            test_shash_free(shash);
+            return NULL;
+        }
+    }
+    return shash;
+}
+
+/* stripe selection uses the high bits of a multiplicative hash, so that it does not
+ * correlate with the bucket index computed by each stripe's hash_t */
+static inline unsigned int test_shash_stripe(test_shash_t * shash, const void * data) {
+    uint64_t h = (uint64_t) ((uintptr_t) data) * UINT64_C(0x9e3779b97f4a7c15);
+    return (unsigned int) ((h >> 32) % shash->n_stripes);
+}
+
+static int test_shash_insert(test_shash_t * shash, void * data) {
+    unsigned int    i = test_shash_stripe(shash, data);
+    int             ret;
+
+    pthread_mutex_lock(&(shash->locks[i]));
+    ret = hash_insert(shash->hashs[i], data);
+    pthread_mutex_unlock(&(shash->locks[i]));
+    return ret;
+}
+
+static void * test_shash_find(test_shash_t * shash, const void * data) {
+    unsigned int    i = test_shash_stripe(shash, data);
+    void *          ret;
+
+    pthread_mutex_lock(&(shash->locks[i]));
+    ret = hash_find(shash->hashs[i], data);
+    pthread_mutex_unlock(&(shash->locks[i]));
+    return ret;
+}
+
+typedef struct {
+    test_shash_t *  shash;
+    size_t          first;      /* first key index of this worker */
+    size_t          nb;         /* number of keys inserted by this worker */
+    size_t          range;      /* keys are (1 + (first + i) % range) */
+    size_t          n_errors;
+} test_shash_job_t;
+
+static void * test_shash_job(void * vdata) {
+    test_shash_job_t *  job = (test_shash_job_t *) vdata;
+    int                 overlap = (job->range != SIZE_MAX);
+
+    for (size_t i = 0; i < job->nb; ++i) {
+        void * key = (void *) (1 + (overlap ? (job->first + i) % job->range : job->first + i));
+        /* with overlapping keys, insert fails when another worker was first: not an error */
+        if ((test_shash_insert(job->shash, key) != HASH_SUCCESS && !overlap)
+        ||  test_shash_find(job->shash, key) != key) {
+            ++(job->n_errors);
+        }
+    }
+    return NULL;
+}
+
+static void test_hash_parallel_bench(testgroup_t * test, size_t nb) {
+    log_t *             log = test != NULL ? test->log : NULL;
+    unsigned int        n_cpus = vjob_cpu_nb();
+    static const struct {
+        const char *    name;
+        unsigned int    n_stripes;
+    } configs[] = { { "global-mutex", 1 }, { "striped", 256 } };
+    test_shash_job_t *  jobs_data;
+    vjob_t **           jobs;
+    BENCH_TM_DECL(tm_bench);
+
+    if (n_cpus == 0)
+        n_cpus = 1;
+    if ((jobs_data = calloc(n_cpus, sizeof(*jobs_data))) == NULL
+    ||  (jobs = calloc(n_cpus, sizeof(*jobs))) == NULL) {
+        TEST_CHECK(test, "parallel hash bench malloc", 0);
+        if (jobs_data != NULL)
+            free(jobs_data);
+        return ;
+    }
+
+    for (unsigned int overlap = 0; overlap < 2; ++overlap) {
+        for (unsigned int i_cfg = 0; i_cfg < PTR_COUNT(configs); ++i_cfg) {
+            /* thread counts: 1, 2, 4, ..., n_cpus */
+            for (unsigned int n_threads = 1, last = 0; !last;
+                    last = (n_threads >= n_cpus),
+                    n_threads = (n_threads * 2 > n_cpus ? n_cpus : n_threads * 2)) {
+                size_t          per_thread = nb / n_threads;
+                size_t          distinct = overlap ? per_thread : per_thread * n_threads;
+                size_t          n_errors = 0, n_found = 0;
+                test_shash_t *  shash;
+                long            duration;
+
+                TEST_CHECK2(test, "parallel hash create(%s)",
+                    (shash = test_shash_create(configs[i_cfg].n_stripes, distinct / 4,
+                                               0)) != NULL,
+                    configs[i_cfg].name);
+                if (shash == NULL)
+                    continue ;
+
+                BENCH_TM_START(tm_bench);
+                for (unsigned int i = 0; i < n_threads; ++i) {
+                    jobs_data[i] = (test_shash_job_t) {
+                        .shash = shash, .nb = per_thread, .n_errors = 0,
+                        .first = overlap ? (per_thread / n_threads) * i : per_thread * i,
+                        .range = overlap ? per_thread : SIZE_MAX };
+                    jobs[i] = vjob_run(test_shash_job, &(jobs_data[i]));
+                }
+                for (unsigned int i = 0; i < n_threads; ++i) {
+                    if (jobs[i] == NULL) {
+                        ++n_errors;
+                    } else {
+                        vjob_waitandfree(jobs[i]);
+                        n_errors += jobs_data[i].n_errors;
+                    }
+                }
+                BENCH_TM_STOP(tm_bench);
+                duration = BENCH_TM_GET(tm_bench);
+
+                LOG_INFO(log, "parallel hash %s(%s) threads=%u: %zu insert+find "
+                              "in %ld ms (%.0f kops/s)",
+                         configs[i_cfg].name, overlap ? "overlapping" : "disjoint", n_threads,
+                         per_thread * n_threads, duration,
+                         duration > 0 ? (double) (per_thread * n_threads) / duration : 0.0);
+
+                for (size_t i = 0; i < distinct; ++i) {
+                    if (test_shash_find(shash, (void *) (1 + i)) == (void *) (1 + i))
+                        ++n_found;
+                }
+                TEST_CHECK2(test, "parallel hash %s(%s) threads=%u: %zu errors, %zu/%zu found",
+                            n_errors == 0 && n_found == distinct,
+                            configs[i_cfg].name, overlap ? "overlapping" : "disjoint",
+                            n_threads, n_errors, n_found, distinct);
+                test_shash_free(shash);
+            }
+        }
+    }
+    free(jobs);
+    free(jobs_data);
+}
+
+/* hash_t with the entries it stores allocated from slabs owned by the test or
+ * one malloc per entry: hash_t chain nodes cannot be taken from a test allocator.
+ * With malloc, hash_free() frees each entry through the free function; with
+ * slabs, no free function is registered and teardown is a handful of free(). */
+typedef struct {
+    size_t                  key;
+    size_t                  value;
+} test_hentry_t;
+
+#define TEST_HENTRY_SLAB_NB 4096
+
+static unsigned int test_hentry_hash(hash_t * hash, const void * data) {
+    (void) hash;
+    return test_hash_ptr_mix((const void *) ((const test_hentry_t *) data)->key);
+}
+
+static int test_hentry_cmp(const void * a, const void * b) {
+    size_t ka = ((const test_hentry_t *) a)->key, kb = ((const test_hentry_t *) b)->key;
+    return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+static void test_hash_slab_entries_bench(testgroup_t * test, size_t nb, unsigned int n_buckets) {
+    log_t *             log = test != NULL ? test->log : NULL;
+    test_hentry_t **    slabs;
+    size_t              n_slabs = (nb + TEST_HENTRY_SLAB_NB - 1) / TEST_HENTRY_SLAB_NB;
+    const unsigned int  seed = time(NULL);
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    if ((slabs = calloc(n_slabs, sizeof(*slabs))) == NULL) {
+        TEST_CHECK(test, "hash slab entries bench malloc", 0);
+        return ;
+    }
+
+    for (unsigned int slab = 0; slab < 2; ++slab) {
+        const char *    name = slab ? "slab" : "malloc";
+        size_t          n_found = 0, n_errors = 0;
+        hash_t *        hash;
+
+        TEST_CHECK2(test, "hash_alloc(entries,%s,sz=%u) not NULL",
+                    (hash = hash_alloc(n_buckets, HASH_FLAG_DOUBLES, test_hentry_hash,
+                                       test_hentry_cmp, slab ? NULL : free)) != NULL,
+                    name, n_buckets);
+        if (hash == NULL) {
+            continue ;
+        }
+
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < nb; ++i) {
+            test_hentry_t * entry;
+
+            if (slab) {
+                if (i % TEST_HENTRY_SLAB_NB == 0
+                &&  (slabs[i / TEST_HENTRY_SLAB_NB]
+                        = malloc(TEST_HENTRY_SLAB_NB * sizeof(**slabs))) == NULL) {
+                    ++n_errors;
+                    break ;
+                }
+                entry = &(slabs[i / TEST_HENTRY_SLAB_NB][i % TEST_HENTRY_SLAB_NB]);
+            } else if ((entry = malloc(sizeof(*entry))) == NULL) {
+                ++n_errors;
+                break ;
+            }
+            entry->key = ((size_t)rand()) % (nb * 10UL);
+            entry->value = i;
+            if (hash_insert(hash, entry) != HASH_SUCCESS) {
+                if (!slab)
+                    free(entry);
+                ++n_errors;
+            }
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "hash entries insert(%s,sz=%u,nb=%zu)",
+                        name, n_buckets, nb);
+
+        srand(seed);
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < nb; ++i) {
+            test_hentry_t   ref = { ((size_t)rand()) % (nb * 10UL), 0 };
+            test_hentry_t * entry = hash_find(hash, &ref);
+
+            if (entry != NULL && entry->key == ref.key) {
+                ++n_found;
+            }
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "hash entries find(%s,sz=%u,nb=%zu)",
+                        name, n_buckets, nb);
+
+        BENCHS_START(tm_bench, cpu_bench);
+        hash_free(hash);
+        if (slab) {
+            for (size_t i = 0; i < n_slabs; ++i) {
+                if (slabs[i] != NULL) {
+                    free(slabs[i]);
+                    slabs[i] = NULL;
+                }
+            }
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "hash entries free(%s,sz=%u,nb=%zu)",
+                        name, n_buckets, nb);
+
+        TEST_CHECK2(test, "hash entries(%s): %zu errors, %zu/%zu found",
+                    n_errors == 0 && n_found == nb, name, n_errors, n_found, nb);
+    }
+    free(slabs);
+}
+
+static inline uint64_t test_hash_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+typedef struct test_hnode_s {
+    void *                  data;
+    struct test_hnode_s *   next;
+} test_hnode_t;
+
+/* Model of a chained table with an opt-in growth policy: when the load factor
+ * reaches 1, the bucket array is doubled and the old buckets are migrated
+ * migrate_step at a time on each subsequent insert, instead of all at once.
+ * Finds look into the old buckets that were not migrated yet.
+ * migrate_step == 0 means a full rehash inside the insert that triggers it. */
+typedef struct {
+    test_hnode_t **     buckets;
+    size_t              size;
+    test_hnode_t **     old;
+    size_t              old_size;
+    size_t              migrate_idx;
+    size_t              migrate_step;
+    size_t              n_elements;
+    size_t              n_resizes;
+} test_ihash_t;
+
+static void test_ihash_migrate(test_ihash_t * ih, size_t n_buckets) {
+    for ( ; n_buckets > 0 && ih->migrate_idx < ih->old_size; --n_buckets, ++ih->migrate_idx) {
+        for (test_hnode_t * node = ih->old[ih->migrate_idx], * next; node != NULL; node = next) {
+            size_t ib = test_hash_ptr_mix(node->data) & (ih->size - 1);
+
+            next = node->next;
+            node->next = ih->buckets[ib];
+            ih->buckets[ib] = node;
+        }
+    }
+    if (ih->migrate_idx == ih->old_size) {
+        free(ih->old);
+        ih->old = NULL;
+    }
+}
+
+static int test_ihash_insert(test_ihash_t * ih, void * data) {
+    test_hnode_t *  node;
+    size_t          ib;
+
+    if (ih->old != NULL) {
+        test_ihash_migrate(ih, ih->migrate_step);
+    }
+    if (ih->n_elements >= ih->size) {
+        test_hnode_t ** buckets;
+
+        if (ih->old != NULL) {
+            test_ihash_migrate(ih, ih->old_size);
+        }
+        if ((buckets = calloc(ih->size * 2, sizeof(*buckets))) == NULL) {
+            return -1;
+        }
+        ih->old = ih->buckets;
+        ih->old_size = ih->size;
+        ih->migrate_idx = 0;
+        ih->buckets = buckets;
+        ih->size *= 2;
+        ++ih->n_resizes;
+        test_ihash_migrate(ih, ih->migrate_step == 0 ? ih->old_size : ih->migrate_step);
+    }
+    if ((node = malloc(sizeof(*node))) == NULL) {
+        return -1;
+    }
+    ib = test_hash_ptr_mix(data) & (ih->size - 1);
+    node->data = data;
+    node->next = ih->buckets[ib];
+    ih->buckets[ib] = node;
+    ++ih->n_elements;
+    return 0;
+}
+
+static void * test_ihash_find(const test_ihash_t * ih, const void * data) {
+    unsigned int hash = test_hash_ptr_mix(data);
+
+    for (test_hnode_t * node = ih->buckets[hash & (ih->size - 1)]; node != NULL;
+            node = node->next) {
+        if (node->data == data)
+            return node->data;
+    }
+    if (ih->old != NULL && (hash & (ih->old_size - 1)) >= ih->migrate_idx) {
+        for (test_hnode_t * node = ih->old[hash & (ih->old_size - 1)]; node != NULL;
+                node = node->next) {
+            if (node->data == data)
+                return node->data;
+        }
+    }
+    return NULL;
+}
+
+static void test_ihash_free(test_ihash_t * ih) {
+    if (ih->old != NULL) {
+        test_ihash_migrate(ih, ih->old_size);
+    }
+    for (size_t ib = 0; ib < ih->size; ++ib) {
+        for (test_hnode_t * node = ih->buckets[ib], * next; node != NULL; node = next) {
+            next = node->next;
+            free(node);
+        }
+    }
+    free(ih->buckets);
+    ih->buckets = NULL;
+}
+
+static void test_hash_growth_bench(testgroup_t * test, size_t nb) {
+    log_t *             log = test != NULL ? test->log : NULL;
+    static const size_t steps[] = { 0, 1, 8, 64 };
+    const unsigned int  seed = time(NULL);
+
+    for (unsigned int i_step = 0; i_step < PTR_COUNT(steps); ++i_step) {
+        test_ihash_t    ih = { .size = 16, .migrate_step = steps[i_step] };
+        uint64_t        max_ns = 0, total_ns = 0, t0, t1;
+        size_t          n_errors = 0, n_found = 0;
+        char            name[32];
+
+        if (steps[i_step] == 0)
+            snprintf(name, sizeof(name), "full-rehash");
+        else
+            snprintf(name, sizeof(name), "incremental/%zu", steps[i_step]);
+
+        if ((ih.buckets = calloc(ih.size, sizeof(*ih.buckets))) == NULL) {
+            TEST_CHECK(test, "hash growth bench malloc", 0);
+            return ;
+        }
+        srand(seed);
+        for (size_t i = 0; i < nb; ++i) {
+            void * value = (void*)(((size_t)rand()) % (nb * 10UL));
+
+            t0 = test_hash_now_ns();
+            if (test_ihash_insert(&ih, value) != 0)
+                ++n_errors;
+            t1 = test_hash_now_ns();
+            total_ns += t1 - t0;
+            if (t1 - t0 > max_ns)
+                max_ns = t1 - t0;
+        }
+        LOG_INFO(log, "hash growth(%s,nb=%zu): %zu resizes, final size %zu, inserts %lu ms,"
+                      " worst insert %lu us", name, nb, ih.n_resizes, ih.size,
+                 (unsigned long) (total_ns / 1000000), (unsigned long) (max_ns / 1000));
+
+        srand(seed);
+        for (size_t i = 0; i < nb; ++i) {
+            void * value = (void*)(((size_t)rand()) % (nb * 10UL));
+            if (test_ihash_find(&ih, value) == value)
+                ++n_found;
+        }
+        TEST_CHECK2(test, "hash growth(%s): %zu errors, %zu elements, %zu/%zu found",
+                    n_errors == 0 && ih.n_elements == nb && n_found == nb,
+                    name, n_errors, ih.n_elements, n_found, nb);
+        test_ihash_free(&ih);
+    }
+}
+
 static void test_one_hash_insert(
                     hash_t *hash, const char * str,
                     const options_test_t * opts, testgroup_t * test) {
@@ -100,6 +833,10 @@ void * test_hash(void * vdata) {
     static const char * const   hash_strs[] = {
         VERSION_STRING, "a", "z", "ab", "ac", "cxz", "trz", NULL
     };
+    static const struct {
+        const char *    name;
+        unsigned int    (*fun)(hash_t *, const void *);
+    } str_funs[] = { { "hash_str", hash_str }, { "hash_test_strw", hash_test_strw } };
 
     hash = hash_alloc(HASH_DEFAULT_SIZE, 0, hash_ptr, hash_ptrcmp, NULL);
     TEST_CHECK(test, "hash_alloc not NULL", hash != NULL);
@@ -113,52 +850,99 @@ void * test_hash(void * vdata) {
         hash_free(hash);
     }
 
-    for (unsigned int hash_size = 1; hash_size < 200; hash_size += 100) {
-        TEST_CHECK2(test, "hash_alloc(sz=%u) not NULL",
-                (hash = hash_alloc(hash_size, 0, hash_str, (hash_cmp_fun_t) strcmp, NULL)) != NULL,
-                hash_size);
-        if (hash == NULL) {
-            continue ;
-        }
+    test_hash_strw_check(hash_strs, test);
 
-        for (const char *const* strs = hash_strs; *strs; strs++) {
-            test_one_hash_insert(hash, *strs, opts, test);
-        }
+    for (unsigned int i_fun = 0; i_fun < PTR_COUNT(str_funs); ++i_fun) {
+        for (unsigned int hash_size = 1; hash_size < 200; hash_size += 100) {
+            TEST_CHECK2(test, "hash_alloc(%s,sz=%u) not NULL",
+                    (hash = hash_alloc(hash_size, 0, str_funs[i_fun].fun,
+                                       (hash_cmp_fun_t) strcmp, NULL)) != NULL,
+                    str_funs[i_fun].name, hash_size);
+            if (hash == NULL) {
+                continue ;
+            }
 
-        if (log->level >= LOG_LVL_INFO) {
-            TEST_CHECK(test, "hash_print_stats OK", hash_print_stats(hash, log->out) > 0);
+            for (const char *const* strs = hash_strs; *strs; strs++) {
+                test_one_hash_insert(hash, *strs, opts, test);
+            }
+
+            if (log->level >= LOG_LVL_INFO) {
+                TEST_CHECK(test, "hash_print_stats OK", hash_print_stats(hash, log->out) > 0);
+            }
+            hash_free(hash);
         }
-        hash_free(hash);
     }
 
     if ((opts->test_mode & TEST_MASK(TEST_bighash)) != 0) {
-        unsigned int hash_sizes[] = { 1000, 500000, 1000000 };
-        srand(time(NULL));
-        for (unsigned int i = 0; i < PTR_COUNT(hash_sizes); ++i) {
-            const size_t nb = 10*1000*1000;
-            unsigned int hash_size = hash_sizes[i];
+        test_hash_str_bench(test);
+
+        /* hash configurations compared head-to-head, on the same sequence of keys */
+        static const struct {
+            const char *    name;
+            unsigned int    size;
+            unsigned int    flags;
+        } hash_configs[] = {
+            { "chained", 1000,      HASH_FLAG_DOUBLES },
+            { "chained", 500000,    HASH_FLAG_DOUBLES },
+            { "chained", 1000000,   HASH_FLAG_DOUBLES },
+        };
+        const size_t        nb = 10*1000*1000;
+        const unsigned int  seed = time(NULL);
+
+        for (unsigned int i = 0; i < PTR_COUNT(hash_configs); ++i) {
+            const char *    name = hash_configs[i].name;
+            unsigned int    hash_size = hash_configs[i].size;
+            size_t          n_found;
             BENCHS_DECL(tm_bench, cpu_bench);
-            TEST_CHECK2(test, "big hash_alloc(sz=%u, nb=%zu) not NULL",
-                        (hash = hash_alloc(hash_size, HASH_FLAG_DOUBLES, hash_ptr, hash_ptrcmp, NULL)) != NULL,
-                         hash_size, nb);
+            TEST_CHECK2(test, "big hash_alloc(%s,sz=%u, nb=%zu) not NULL",
+                        (hash = hash_alloc(hash_size, hash_configs[i].flags,
+                                           hash_ptr, hash_ptrcmp, NULL)) != NULL,
+                         name, hash_size, nb);
+            if (hash == NULL) {
+                continue ;
+            }
 
+            srand(seed);
             BENCHS_START(tm_bench, cpu_bench);
             for (size_t i = 0; i < nb; ++i) {
                 void * value = (void*)(((size_t)rand()) % (nb * 10UL));
                 if (hash_insert(hash, value) != 0) {
-                    TEST_CHECK2(test, "error big hash_insert(sz=%u,nb=%zu,elt=%lx)", 0, hash_size, nb, (unsigned long) value);
+                    TEST_CHECK2(test, "error big hash_insert(%s,sz=%u,nb=%zu,elt=%lx)", 0,
+                                name, hash_size, nb, (unsigned long) value);
                 }
             }
-            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "big hash_inserts(sz=%u,nb=%zu)", hash_size, nb);
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "big hash_inserts(%s,sz=%u,nb=%zu)",
+                            name, hash_size, nb);
 
             if (log->level >= LOG_LVL_VERBOSE) {
                 TEST_CHECK(test, "hash_print_stats OK", hash_print_stats(hash, log->out) > 0);
             }
 
+            /* replay the same keys: every lookup must succeed */
+            srand(seed);
+            n_found = 0;
+            BENCHS_START(tm_bench, cpu_bench);
+            for (size_t i = 0; i < nb; ++i) {
+                void * value = (void*)(((size_t)rand()) % (nb * 10UL));
+                if (hash_find(hash, value) == value) {
+                    ++n_found;
+                }
+            }
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "big hash_finds(%s,sz=%u,nb=%zu)",
+                            name, hash_size, nb);
+            TEST_CHECK2(test, "big hash_find(%s,sz=%u): %zu/%zu found", n_found == nb,
+                        name, hash_size, n_found, nb);
+
             BENCHS_START(tm_bench, cpu_bench);
             hash_free(hash);
-            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "big hash_free(sz=%u, nb=%zu)", hash_size, nb);
+            BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "big hash_free(%s,sz=%u, nb=%zu)",
+                            name, hash_size, nb);
         }
+        test_oahash_bench(test, nb, seed);
+
+        test_hash_slab_entries_bench(test, nb, 1000000);
+        test_hash_growth_bench(test, nb);
+        test_hash_parallel_bench(test, 4 * 1000 * 1000);
     }
 
     return VOIDP(TEST_END(test));
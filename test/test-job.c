@@ -29,6 +29,8 @@
 extern int ___nothing___; /* empty */
 #else
 #include <stdlib.h>
+#include <string.h>
+#include <time.h>
 
 #include "vlib/job.h"
 #include "vlib/test.h"
@@ -84,6 +86,519 @@ static void * pr_job(void * vdata) {
     return (void *)((unsigned long) i);
 }
 
+/* ************************************************************************ */
+/* JOB POOL */
+/* ************************************************************************ */
+/** Persistent worker pool: jobs are queued round-robin on per-worker deques
+ * and run by long-lived workers, instead of one pthread created per vjob_run().
+ * Each deque is consumed in submission order (FIFO), by its owner or by idle
+ * workers stealing from it. Workers are started lazily on first submit,
+ * vjob_cpu_nb() of them by default, each one optionally pinned on a cpu.
+ * A running pool job cannot be cancelled without losing its worker:
+ * test_jobpool_kill() only drops queued jobs and waits for running ones. */
+enum {
+    TEST_JOBPOOL_QUEUED = 0,
+    TEST_JOBPOOL_RUNNING,
+    TEST_JOBPOOL_DONE,
+    TEST_JOBPOOL_KILLED,
+};
+
+typedef struct test_jobpool_s test_jobpool_t;
+
+typedef struct {
+    void *                  (*fun)(void *);
+    void *                  data;
+    void *                  result;
+    volatile unsigned int   state;
+    volatile unsigned int   refs;           /* owner handle + queue */
+    test_jobpool_t *        pool;
+} test_jobpool_job_t;
+
+typedef struct {
+    pthread_mutex_t         lock;
+    test_jobpool_job_t **   jobs;
+    size_t                  top;
+    size_t                  bottom;
+    size_t                  size;
+} test_jobpool_deque_t;
+
+typedef struct {
+    test_jobpool_t *        pool;
+    unsigned int            id;
+    unsigned long           n_steals;
+} test_jobpool_worker_t;
+
+struct test_jobpool_s {
+    unsigned int            n_workers;
+    unsigned int            next;           /* round-robin submit target */
+    volatile unsigned long  n_queued;
+    unsigned int            n_sleeping;
+    unsigned int            n_waiters;
+    int                     stop;
+    const int *             cpus;           /* cpu of each worker, or NULL */
+    volatile unsigned int   n_pin_errors;
+    pthread_mutex_t         lock;           /* sleep/wakeup of workers */
+    pthread_cond_t          cond;
+    pthread_mutex_t         done_lock;      /* completion of jobs */
+    pthread_cond_t          done_cond;
+    test_jobpool_deque_t *  deques;
+    test_jobpool_worker_t * workers;
+    vjob_t **               threads;
+};
+
+/* cpus, if not NULL, holds the cpu of each of the n_workers (n_workers > 0) */
+static test_jobpool_t * test_jobpool_create(unsigned int n_workers, const int * cpus) {
+    test_jobpool_t * pool;
+
+    if ((cpus != NULL && n_workers == 0) || (pool = calloc(1, sizeof(*pool))) == NULL)
+        return NULL;
+    pool->n_workers = n_workers;
+    pool->cpus = cpus;
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    pthread_mutex_init(&pool->done_lock, NULL);
+    pthread_cond_init(&pool->done_cond, NULL);
+    return pool;
+}
+
+static int test_jobpool_deque_push(test_jobpool_deque_t * deque, test_jobpool_job_t * job) {
+    int ret = 0;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->bottom == deque->size) {
+        if (deque->top > 0) {
+            memmove(deque->jobs, deque->jobs + deque->top,
+                    (deque->bottom - deque->top) * sizeof(*deque->jobs));
+            deque->bottom -= deque->top;
+            deque->top = 0;
+        } else {
+            size_t                  size = deque->size ? deque->size * 2 : 256;
+            test_jobpool_job_t **   jobs = realloc(deque->jobs, size * sizeof(*jobs));
+            if (jobs == NULL) {
+                ret = -1;
+            } else {
+                deque->jobs = jobs;
+                deque->size = size;
+            }
+        }
+    }
+    if (ret == 0)
+        deque->jobs[deque->bottom++] = job;
+    pthread_mutex_unlock(&deque->lock);
+    return ret;
+}
+
+/* jobs are taken at the top, in submission order, by the owner and by thieves */
+static test_jobpool_job_t * test_jobpool_deque_pop(test_jobpool_deque_t * deque) {
+    test_jobpool_job_t * job = NULL;
+
+    pthread_mutex_lock(&deque->lock);
+    if (deque->top < deque->bottom) {
+        job = deque->jobs[deque->top++];
+        if (deque->top == deque->bottom)
+            deque->top = deque->bottom = 0;
+    }
+    pthread_mutex_unlock(&deque->lock);
+    return job;
+}
+
+static void test_jobpool_job_finish(test_jobpool_t * pool, test_jobpool_job_t * job,
+                                    unsigned int state) {
+    pthread_mutex_lock(&pool->done_lock);
+    /* full barrier: result is visible before state */
+    __sync_bool_compare_and_swap(&job->state, TEST_JOBPOOL_RUNNING, state);
+    if (pool->n_waiters > 0)
+        pthread_cond_broadcast(&pool->done_cond);
+    pthread_mutex_unlock(&pool->done_lock);
+}
+
+static void test_jobpool_job_release(test_jobpool_job_t * job) {
+    if (__sync_sub_and_fetch(&job->refs, 1) == 0)
+        free(job);
+}
+
+static void * test_jobpool_worker(void * vdata) {
+    test_jobpool_worker_t * worker = (test_jobpool_worker_t *) vdata;
+    test_jobpool_t *        pool = worker->pool;
+    test_jobpool_job_t *    job;
+
+    /* a refused pin (cpuset of a container) is counted, the worker runs unpinned */
+    if (pool->cpus != NULL && test_cpu_pin(pool->cpus[worker->id]) != 0)
+        __sync_fetch_and_add(&pool->n_pin_errors, 1);
+    while (1) {
+        job = test_jobpool_deque_pop(&pool->deques[worker->id]);
+        for (unsigned int i = 1; job == NULL && i < pool->n_workers; ++i) {
+            job = test_jobpool_deque_pop(&pool->deques[(worker->id + i) % pool->n_workers]);
+            if (job != NULL)
+                ++worker->n_steals;
+        }
+        if (job == NULL) {
+            pthread_mutex_lock(&pool->lock);
+            while (__sync_fetch_and_add(&pool->n_queued, 0) == 0 && !pool->stop) {
+                ++pool->n_sleeping;
+                pthread_cond_wait(&pool->cond, &pool->lock);
+                --pool->n_sleeping;
+            }
+            if (__sync_fetch_and_add(&pool->n_queued, 0) == 0 && pool->stop) {
+                pthread_mutex_unlock(&pool->lock);
+                break ;
+            }
+            pthread_mutex_unlock(&pool->lock);
+            continue ;
+        }
+        __sync_fetch_and_sub(&pool->n_queued, 1);
+        if (__sync_bool_compare_and_swap(&job->state, TEST_JOBPOOL_QUEUED, TEST_JOBPOOL_RUNNING)) {
+            job->result = job->fun(job->data);
+            test_jobpool_job_finish(pool, job, TEST_JOBPOOL_DONE);
+        } /* else killed while queued */
+        test_jobpool_job_release(job);
+    }
+    return VOIDP(worker->n_steals);
+}
+
+/** stops the workers once queued jobs are consumed, and releases them: the pool
+ * is back to its state before test_jobpool_start(). Returns the number of steals. */
+static unsigned long test_jobpool_stop(test_jobpool_t * pool) {
+    unsigned long n_steals = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stop = 1;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    for (unsigned int i = 0; pool->threads != NULL && i < pool->n_workers; ++i) {
+        if (pool->threads[i] != NULL)
+            n_steals += (unsigned long) vjob_waitandfree(pool->threads[i]);
+    }
+    for (unsigned int i = 0; pool->deques != NULL && i < pool->n_workers; ++i) {
+        pthread_mutex_destroy(&pool->deques[i].lock);
+        free(pool->deques[i].jobs);
+    }
+    free(pool->deques);
+    free(pool->workers);
+    free(pool->threads);
+    pool->deques = NULL;
+    pool->workers = NULL;
+    pool->threads = NULL;
+    pool->stop = 0;
+    return n_steals;
+}
+
+static int test_jobpool_start(test_jobpool_t * pool) {
+    if (pool->n_workers == 0)
+        pool->n_workers = vjob_cpu_nb() > 0 ? vjob_cpu_nb() : 1;
+    pool->deques = calloc(pool->n_workers, sizeof(*pool->deques));
+    pool->workers = calloc(pool->n_workers, sizeof(*pool->workers));
+    pool->threads = calloc(pool->n_workers, sizeof(*pool->threads));
+    if (pool->deques == NULL || pool->workers == NULL || pool->threads == NULL) {
+        free(pool->deques);
+        free(pool->workers);
+        free(pool->threads);
+        pool->deques = NULL;
+        pool->workers = NULL;
+        pool->threads = NULL;
+        return -1;
+    }
+    for (unsigned int i = 0; i < pool->n_workers; ++i) {
+        pthread_mutex_init(&pool->deques[i].lock, NULL);
+        pool->workers[i] = (test_jobpool_worker_t) { .pool = pool, .id = i, .n_steals = 0 };
+    }
+    for (unsigned int i = 0; i < pool->n_workers; ++i) {
+        if ((pool->threads[i] = vjob_run(test_jobpool_worker, &pool->workers[i])) == NULL) {
+            test_jobpool_stop(pool);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static test_jobpool_job_t * test_jobpool_submit(test_jobpool_t * pool, void * (*fun)(void *),
+                                                void * data) {
+    test_jobpool_job_t * job;
+
+    if (pool->threads == NULL && test_jobpool_start(pool) != 0)
+        return NULL;
+    if ((job = malloc(sizeof(*job))) == NULL)
+        return NULL;
+    *job = (test_jobpool_job_t) { .fun = fun, .data = data, .result = VJOB_NO_RESULT,
+                                  .state = TEST_JOBPOOL_QUEUED, .refs = 2, .pool = pool };
+    if (test_jobpool_deque_push(&pool->deques[__sync_fetch_and_add(&pool->next, 1)
+                                              % pool->n_workers], job) != 0) {
+        free(job);
+        return NULL;
+    }
+    pthread_mutex_lock(&pool->lock);
+    __sync_fetch_and_add(&pool->n_queued, 1);
+    if (pool->n_sleeping > 0)
+        pthread_cond_signal(&pool->cond);
+    pthread_mutex_unlock(&pool->lock);
+    return job;
+}
+
+static int test_jobpool_done(test_jobpool_job_t * job) {
+    unsigned int state = __sync_fetch_and_add(&job->state, 0);
+    return state == TEST_JOBPOOL_DONE || state == TEST_JOBPOOL_KILLED;
+}
+
+static void * test_jobpool_wait(test_jobpool_job_t * job) {
+    test_jobpool_t * pool = job->pool;
+
+    if (!test_jobpool_done(job)) {
+        pthread_mutex_lock(&pool->done_lock);
+        ++pool->n_waiters;
+        while (!test_jobpool_done(job))
+            pthread_cond_wait(&pool->done_cond, &pool->done_lock);
+        --pool->n_waiters;
+        pthread_mutex_unlock(&pool->done_lock);
+    }
+    return job->result;
+}
+
+static void * test_jobpool_kill(test_jobpool_job_t * job) {
+    if (__sync_bool_compare_and_swap(&job->state, TEST_JOBPOOL_QUEUED, TEST_JOBPOOL_KILLED))
+        return VJOB_NO_RESULT;
+    return test_jobpool_wait(job);
+}
+
+static void * test_jobpool_free(test_jobpool_job_t * job) {
+    void * result = test_jobpool_wait(job);
+    test_jobpool_job_release(job);
+    return result;
+}
+
+/** stop workers once queued jobs are consumed, and release the pool */
+static unsigned long test_jobpool_destroy(test_jobpool_t * pool) {
+    unsigned long n_steals;
+
+    if (pool == NULL)
+        return 0;
+    n_steals = test_jobpool_stop(pool);
+    pthread_cond_destroy(&pool->done_cond);
+    pthread_mutex_destroy(&pool->done_lock);
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    free(pool);
+    return n_steals;
+}
+
+static inline uint64_t job_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+typedef struct {
+    uint64_t            submit_ns;
+    uint64_t            start_ns;
+} job_latency_t;
+
+static void * job_latency_fun(void * vdata) {
+    ((job_latency_t *) vdata)->start_ns = job_now_ns();
+    return vdata;
+}
+
+static void * job_tiny_fun(void * vdata) {
+    return VOIDP((unsigned long) vdata + 1);
+}
+
+typedef struct {
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    int                 open;
+} job_gate_t;
+
+/* holds its worker until the gate is opened */
+static void * job_gate_fun(void * vdata) {
+    job_gate_t * gate = (job_gate_t *) vdata;
+
+    pthread_mutex_lock(&gate->lock);
+    while (!gate->open)
+        pthread_cond_wait(&gate->cond, &gate->lock);
+    pthread_mutex_unlock(&gate->lock);
+    return vdata;
+}
+
+static void test_job_pool(const options_test_t * opts, testgroup_t * test) {
+    log_t *             log = test != NULL ? test->log : NULL;
+    /* 1M tiny pool jobs (and their handles) only with TEST_bigjob */
+    const int           big = (opts->test_mode & TEST_MASK(TEST_bigjob)) != 0;
+    const size_t        n_latency = 2000, n_spawn = 10000, batch = 64;
+    const size_t        n_tiny = big ? 1000 * 1000 : 10 * 1000;
+    test_jobpool_t *    pool;
+    test_jobpool_job_t ** jobs;
+    vjob_t *            spawned[64];
+    test_topo_t         topo;
+    int *               cpus = NULL;
+    job_latency_t       lat;
+    uint64_t            lat_sum, lat_max, t0, t1;
+    unsigned long       n_errors = 0, sum, n_steals;
+    void *              ret;
+
+    if ((jobs = malloc(n_tiny * sizeof(*jobs))) == NULL) {
+        TEST_CHECK(test, "malloc", 0);
+        return ;
+    }
+
+    /* handle semantics */
+    TEST_CHECK(test, "test_jobpool_create", (pool = test_jobpool_create(0, NULL)) != NULL);
+    if (pool == NULL) {
+        free(jobs);
+        return ;
+    }
+    TEST_CHECK(test, "test_jobpool_submit",
+               (jobs[0] = test_jobpool_submit(pool, job_tiny_fun, VOIDP(41))) != NULL);
+    if (jobs[0] != NULL) {
+        TEST_CHECK2(test, "test_jobpool_wait ret %lu",
+                    (ret = test_jobpool_wait(jobs[0])) == VOIDP(42), (unsigned long) ret);
+        TEST_CHECK(test, "test_jobpool_done", test_jobpool_done(jobs[0]));
+        TEST_CHECK2(test, "test_jobpool_free ret %lu",
+                    (ret = test_jobpool_free(jobs[0])) == VOIDP(42), (unsigned long) ret);
+    }
+    TEST_CHECK2(test, "test_jobpool lazy sizing: %u workers (cpus %u)",
+                pool->n_workers == (unsigned int) vjob_cpu_nb()
+                || (vjob_cpu_nb() == 0 && pool->n_workers == 1),
+                pool->n_workers, vjob_cpu_nb());
+
+    /* spawn-to-start latency, one job at a time */
+    lat_sum = lat_max = 0;
+    for (size_t i = 0; i < n_latency; ++i) {
+        vjob_t * job;
+        lat.submit_ns = job_now_ns();
+        if ((job = vjob_run(job_latency_fun, &lat)) == NULL) {
+            ++n_errors;
+            continue ;
+        }
+        vjob_waitandfree(job);
+        lat_sum += lat.start_ns - lat.submit_ns;
+        if (lat.start_ns - lat.submit_ns > lat_max)
+            lat_max = lat.start_ns - lat.submit_ns;
+    }
+    LOG_INFO(log, "vjob_run spawn-to-start latency: avg %.2f us, max %.2f us (%zu jobs)",
+             lat_sum / 1000.0 / n_latency, lat_max / 1000.0, n_latency);
+
+    lat_sum = lat_max = 0;
+    for (size_t i = 0; i < n_latency; ++i) {
+        test_jobpool_job_t * job;
+        lat.submit_ns = job_now_ns();
+        if ((job = test_jobpool_submit(pool, job_latency_fun, &lat)) == NULL) {
+            ++n_errors;
+            continue ;
+        }
+        test_jobpool_free(job);
+        lat_sum += lat.start_ns - lat.submit_ns;
+        if (lat.start_ns - lat.submit_ns > lat_max)
+            lat_max = lat.start_ns - lat.submit_ns;
+    }
+    LOG_INFO(log, "test_jobpool_submit spawn-to-start latency: avg %.2f us, max %.2f us (%zu jobs)",
+             lat_sum / 1000.0 / n_latency, lat_max / 1000.0, n_latency);
+    TEST_CHECK2(test, "latency jobs: %lu errors", n_errors == 0, n_errors);
+
+    /* tiny jobs throughput: vjob_run in batches (bounded number of threads) */
+    sum = 0;
+    t0 = job_now_ns();
+    for (size_t i = 0; i < n_spawn; i += batch) {
+        size_t n = 0;
+        for (size_t j = i; j < i + batch && j < n_spawn; ++j, ++n) {
+            if ((spawned[n] = vjob_run(job_tiny_fun, VOIDP(j))) == NULL)
+                ++n_errors;
+        }
+        for (size_t j = 0; j < n; ++j) {
+            if (spawned[j] != NULL)
+                sum += (unsigned long) vjob_waitandfree(spawned[j]) - 1;
+        }
+    }
+    t1 = job_now_ns();
+    LOG_INFO(log, "vjob_run %zu tiny jobs: %.0f jobs/s", n_spawn,
+             n_spawn / ((t1 - t0) / 1e9));
+    TEST_CHECK2(test, "vjob_run tiny jobs: %lu errors, sum %lu", n_errors == 0
+                && sum == (n_spawn * (n_spawn - 1)) / 2, n_errors, sum);
+
+    sum = 0;
+    t0 = job_now_ns();
+    for (size_t i = 0; i < n_tiny; ++i) {
+        if ((jobs[i] = test_jobpool_submit(pool, job_tiny_fun, VOIDP(i))) == NULL)
+            ++n_errors;
+    }
+    for (size_t i = 0; i < n_tiny; ++i) {
+        if (jobs[i] != NULL)
+            sum += (unsigned long) test_jobpool_free(jobs[i]) - 1;
+    }
+    t1 = job_now_ns();
+    LOG_INFO(log, "test_jobpool_submit %zu tiny jobs: %.0f jobs/s (%u workers)", n_tiny,
+             n_tiny / ((t1 - t0) / 1e9), pool->n_workers);
+    TEST_CHECK2(test, "test_jobpool tiny jobs: %lu errors, sum %lu", n_errors == 0
+                && sum == (n_tiny * (n_tiny - 1)) / 2, n_errors, sum);
+
+    n_steals = test_jobpool_destroy(pool);
+    LOG_INFO(log, "test_jobpool: %lu steals", n_steals);
+
+    /* same tiny jobs with one worker pinned per physical core */
+    if (test_topo_get(&topo) < 0 || (cpus = malloc(topo.n_cores * sizeof(*cpus))) == NULL
+    ||  test_topo_placement(&topo, TEST_PIN_CORES, topo.n_cores, cpus) == NULL) {
+        TEST_CHECK(test, "test_topo_get", 0);
+    } else if ((pool = test_jobpool_create(topo.n_cores, cpus)) == NULL) {
+        TEST_CHECK(test, "test_jobpool_create(one-per-core)", 0);
+    } else {
+        sum = 0;
+        t0 = job_now_ns();
+        for (size_t i = 0; i < n_tiny; ++i) {
+            if ((jobs[i] = test_jobpool_submit(pool, job_tiny_fun, VOIDP(i))) == NULL)
+                ++n_errors;
+        }
+        for (size_t i = 0; i < n_tiny; ++i) {
+            if (jobs[i] != NULL)
+                sum += (unsigned long) test_jobpool_free(jobs[i]) - 1;
+        }
+        t1 = job_now_ns();
+        LOG_INFO(log, "test_jobpool_submit %zu tiny jobs: %.0f jobs/s (%u workers one-per-core, "
+                      "%u pin errors)", n_tiny, n_tiny / ((t1 - t0) / 1e9), pool->n_workers,
+                 __sync_fetch_and_add(&pool->n_pin_errors, 0));
+        TEST_CHECK2(test, "test_jobpool one-per-core tiny jobs: %lu errors, sum %lu",
+                    n_errors == 0 && sum == (n_tiny * (n_tiny - 1)) / 2, n_errors, sum);
+        test_jobpool_destroy(pool);
+    }
+    free(cpus);
+    test_topo_free(&topo);
+
+    /* kill of queued jobs: saturate a single worker pool */
+    TEST_CHECK(test, "test_jobpool_create(1)", (pool = test_jobpool_create(1, NULL)) != NULL);
+    if (pool != NULL) {
+        job_gate_t              gate = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER, 0 };
+        test_jobpool_job_t *    gate_job;
+        size_t                  n_killed = 0;
+
+        /* the only worker is held by the gate job: next jobs stay queued until killed */
+        if ((gate_job = test_jobpool_submit(pool, job_gate_fun, &gate)) == NULL)
+            ++n_errors;
+        for (size_t i = 0; i < 1000; ++i) {
+            if ((jobs[i] = test_jobpool_submit(pool, job_tiny_fun, VOIDP(i))) == NULL)
+                ++n_errors;
+        }
+        for (size_t i = 1000; i > 0; --i) {
+            if (jobs[i - 1] != NULL && test_jobpool_kill(jobs[i - 1]) == VJOB_NO_RESULT)
+                ++n_killed;
+        }
+        pthread_mutex_lock(&gate.lock);
+        gate.open = 1;
+        pthread_cond_broadcast(&gate.cond);
+        pthread_mutex_unlock(&gate.lock);
+        if (gate_job != NULL && test_jobpool_free(gate_job) != &gate)
+            ++n_errors;
+        for (size_t i = 0; i < 1000; ++i) {
+            if (jobs[i] != NULL && (ret = test_jobpool_free(jobs[i])) != VJOB_NO_RESULT
+            &&  ret != VOIDP(i + 1))
+                ++n_errors;
+        }
+        TEST_CHECK2(test, "test_jobpool_kill: %lu errors, %zu killed", n_errors == 0,
+                    n_errors, n_killed);
+        TEST_CHECK2(test, "test_jobpool_kill: %zu/1000 queued jobs killed", n_killed > 0,
+                    n_killed);
+        test_jobpool_destroy(pool);
+        pthread_cond_destroy(&gate.cond);
+        pthread_mutex_destroy(&gate.lock);
+    }
+    free(jobs);
+}
+
 void * test_job(void * vdata) {
     const options_test_t * opts = (const options_test_t *) vdata;
     testgroup_t *   test = TEST_START(opts->testpool, "JOB");
@@ -249,6 +764,9 @@ void * test_job(void * vdata) {
     vsleep_ms((s_PR_JOB_LOOP_NB + 2) * s_PR_JOB_LOOP_SLEEPMS);
     TEST_CHECK2(test, "job has finished, counter %u", (data.pr_job_counter == s_PR_JOB_LOOP_NB), data.pr_job_counter);
 
+    LOG_INFO(log, "* persistent pool vs thread per job...");
+    test_job_pool(opts, test);
+
     return VOIDP(TEST_END(test));
 }
 
@@ -29,6 +29,9 @@
 extern int ___nothing___; /* empty */
 #else
 #include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
 
 #include "vlib/rbuf.h"
 #include "vlib/test.h"
@@ -171,6 +174,681 @@ static int rbuf_dequeue_test(rbuf_t * rbuf, const int * ints, size_t intssz, int
     return 0;
 }
 
+/* *************** MULTI-THREAD QUEUES *************** */
+/* Bounded lock-free MPMC queue (D. Vyukov): each cell carries a sequence number
+ * telling whether it is ready for the producer (seq == pos) or for the consumer
+ * (seq == pos + 1) owning position pos. Producers and consumers only contend on
+ * their own position counter. */
+#define RBUF_TEST_MT_CACHELINE   64
+
+typedef struct {
+    volatile size_t     seq;
+    void *              data;
+} rbuf_test_mpmc_cell_t;
+
+typedef struct {
+    rbuf_test_mpmc_cell_t * cells;
+    size_t                  mask;
+    char                    pad0[RBUF_TEST_MT_CACHELINE];
+    volatile size_t         enqueue_pos;
+    char                    pad1[RBUF_TEST_MT_CACHELINE];
+    volatile size_t         dequeue_pos;
+    char                    pad2[RBUF_TEST_MT_CACHELINE];
+} rbuf_test_mpmc_t;
+
+/* size must be a power of 2 */
+static int rbuf_test_mpmc_init(rbuf_test_mpmc_t * q, size_t size) {
+    memset(q, 0, sizeof(*q));
+    if (size < 2 || (size & (size - 1)) != 0
+    ||  (q->cells = malloc(size * sizeof(*q->cells))) == NULL) {
+        return -1;
+    }
+    for (size_t i = 0; i < size; ++i)
+        q->cells[i].seq = i;
+    q->mask = size - 1;
+    return 0;
+}
+
+static void rbuf_test_mpmc_destroy(rbuf_test_mpmc_t * q) {
+    free(q->cells);
+    q->cells = NULL;
+}
+
+/* returns 0, or -1 if the queue is full */
+static int rbuf_test_mpmc_push(rbuf_test_mpmc_t * q, void * data) {
+    size_t                  pos = q->enqueue_pos;
+    rbuf_test_mpmc_cell_t * cell;
+
+    while (1) {
+        cell = &(q->cells[pos & q->mask]);
+        intptr_t dif = (intptr_t) cell->seq - (intptr_t) pos;
+        if (dif == 0) {
+            if (__sync_bool_compare_and_swap(&q->enqueue_pos, pos, pos + 1))
+                break ;
+        } else if (dif < 0) {
+            return -1;
+        }
+        pos = q->enqueue_pos;
+    }
+    cell->data = data;
+    __sync_synchronize();
+    cell->seq = pos + 1;
+    return 0;
+}
+
+/* returns 0 and the element in *data, or -1 if the queue is empty */
+static int rbuf_test_mpmc_pop(rbuf_test_mpmc_t * q, void ** data) {
+    size_t                  pos = q->dequeue_pos;
+    rbuf_test_mpmc_cell_t * cell;
+
+    while (1) {
+        cell = &(q->cells[pos & q->mask]);
+        intptr_t dif = (intptr_t) cell->seq - (intptr_t) (pos + 1);
+        if (dif == 0) {
+            if (__sync_bool_compare_and_swap(&q->dequeue_pos, pos, pos + 1))
+                break ;
+        } else if (dif < 0) {
+            return -1;
+        }
+        pos = q->dequeue_pos;
+    }
+    *data = cell->data;
+    __sync_synchronize();
+    cell->seq = pos + q->mask + 1;
+    return 0;
+}
+
+/* Reference: rbuf protected by a mutex, with not_empty/not_full conditions */
+typedef struct {
+    rbuf_t *            rbuf;
+    size_t              capacity;
+    size_t              n_popped;
+    size_t              total;
+    int                 stop;       /* set when no consumer could be started */
+    pthread_mutex_t     lock;
+    pthread_cond_t      not_empty;
+    pthread_cond_t      not_full;
+} rbuf_test_locked_t;
+
+/* returns 0, or -1 if the queue was stopped */
+static int rbuf_test_locked_push(rbuf_test_locked_t * q, void * data) {
+    int ret = -1;
+
+    pthread_mutex_lock(&q->lock);
+    while (rbuf_size(q->rbuf) >= q->capacity && !q->stop)
+        pthread_cond_wait(&q->not_full, &q->lock);
+    if (!q->stop) {
+        rbuf_push(q->rbuf, data);
+        pthread_cond_signal(&q->not_empty);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+static void rbuf_test_locked_stop(rbuf_test_locked_t * q) {
+    pthread_mutex_lock(&q->lock);
+    q->stop = 1;
+    pthread_cond_broadcast(&q->not_full);
+    pthread_cond_broadcast(&q->not_empty);
+    pthread_mutex_unlock(&q->lock);
+}
+
+/* returns 0 and the element in *data, or -1 when all elements were consumed */
+static int rbuf_test_locked_pop(rbuf_test_locked_t * q, void ** data) {
+    int ret = -1;
+
+    pthread_mutex_lock(&q->lock);
+    while (rbuf_size(q->rbuf) == 0 && q->n_popped < q->total && !q->stop)
+        pthread_cond_wait(&q->not_empty, &q->lock);
+    if (rbuf_size(q->rbuf) != 0) {
+        *data = rbuf_dequeue(q->rbuf);
+        if (++q->n_popped == q->total)
+            pthread_cond_broadcast(&q->not_empty);
+        pthread_cond_signal(&q->not_full);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return ret;
+}
+
+enum { RBUF_TEST_MT_LOCKED = 0, RBUF_TEST_MT_MPMC, RBUF_TEST_MT_NB };
+
+typedef struct {
+    int                     mode;
+    rbuf_test_locked_t *    locked;
+    rbuf_test_mpmc_t *      mpmc;
+    uint64_t *              stamps;     /* push time of each element, in ns */
+    size_t                  total;
+    volatile size_t *       n_popped;   /* MPMC: elements consumed by all consumers */
+    volatile int            stop;       /* MPMC: set when no consumer could be started */
+} rbuf_test_mt_ctx_t;
+
+typedef struct {
+    rbuf_test_mt_ctx_t *    ctx;
+    size_t                  first;
+    size_t                  nb;
+    size_t                  n_items;
+    size_t                  sum;
+    uint64_t                latency_sum;
+    uint64_t                latency_max;
+} rbuf_test_mt_job_t;
+
+static inline uint64_t rbuf_test_mt_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void * rbuf_test_mt_producer(void * vdata) {
+    rbuf_test_mt_job_t * job = (rbuf_test_mt_job_t *) vdata;
+    rbuf_test_mt_ctx_t * ctx = job->ctx;
+
+    for (size_t i = job->first; i < job->first + job->nb; ++i) {
+        void * data = (void *) (i + 1);
+        ctx->stamps[i] = rbuf_test_mt_now_ns();
+        if (ctx->mode == RBUF_TEST_MT_LOCKED) {
+            if (rbuf_test_locked_push(ctx->locked, data) != 0)
+                break ;
+        } else {
+            int stop = 0;
+            while (rbuf_test_mpmc_push(ctx->mpmc, data) != 0
+            &&     !(stop = __sync_fetch_and_add(&ctx->stop, 0)))
+                sched_yield();
+            if (stop)
+                break ;
+        }
+    }
+    return NULL;
+}
+
+static void * rbuf_test_mt_consumer(void * vdata) {
+    rbuf_test_mt_job_t * job = (rbuf_test_mt_job_t *) vdata;
+    rbuf_test_mt_ctx_t * ctx = job->ctx;
+    void *          data;
+
+    while (1) {
+        if (ctx->mode == RBUF_TEST_MT_LOCKED) {
+            if (rbuf_test_locked_pop(ctx->locked, &data) != 0)
+                break ;
+        } else if (rbuf_test_mpmc_pop(ctx->mpmc, &data) == 0) {
+            __sync_fetch_and_add(ctx->n_popped, 1);
+        } else if (*(ctx->n_popped) >= ctx->total || __sync_fetch_and_add(&ctx->stop, 0)) {
+            break ;
+        } else {
+            sched_yield();
+            continue ;
+        }
+        uint64_t latency = rbuf_test_mt_now_ns() - ctx->stamps[(size_t) data - 1];
+        job->latency_sum += latency;
+        if (latency > job->latency_max)
+            job->latency_max = latency;
+        job->sum += (size_t) data;
+        ++job->n_items;
+    }
+    return NULL;
+}
+
+static void test_rbuf_mt_bench(const options_test_t * opts, testgroup_t * test) {
+    log_t *                 log = test != NULL ? test->log : NULL;
+    static const char *     modes[] = { "rbuf+mutex+cond", "lock-free mpmc" };
+    const unsigned int      n_cpus = vjob_cpu_nb() > 0 ? vjob_cpu_nb() : 1;
+    /* lock-free consumers spin on an empty queue: one per cpu only with TEST_bigrbuf */
+    const unsigned int      configs[][2] = { { 1, 1 }, { 4, 4 }, { UINT_MAX, UINT_MAX },
+                                             { n_cpus, n_cpus } };
+    const size_t            total = 1000 * 1000, capacity = 1024;
+    rbuf_test_mt_job_t *    jobs_data;
+    vjob_t **               jobs;
+    uint64_t *              stamps;
+    BENCH_TM_DECL(tm_bench);
+
+    if ((stamps = malloc(total * sizeof(*stamps))) == NULL
+    ||  (jobs_data = calloc(2 * n_cpus + 8, sizeof(*jobs_data))) == NULL
+    ||  (jobs = calloc(2 * n_cpus + 8, sizeof(*jobs))) == NULL) {
+        TEST_CHECK(test, "rbuf multi-thread bench malloc", 0);
+        if (stamps != NULL) {
+            free(stamps);
+            if (jobs_data != NULL)
+                free(jobs_data);
+        }
+        return ;
+    }
+    for (unsigned int i_cfg = 0; i_cfg < PTR_COUNT(configs); ++i_cfg) {
+        const unsigned int  n_prod = configs[i_cfg][0], n_cons = configs[i_cfg][1];
+        const size_t        per_prod = total / n_prod;
+
+        if (n_prod == UINT_MAX) { /* after UINT_MAX this is only for TEST_bigrbuf */
+            if ((opts->test_mode & TEST_MASK(TEST_bigrbuf)) != 0) continue ; else break ;
+        }
+        for (int mode = 0; mode < RBUF_TEST_MT_NB; ++mode) {
+            size_t                  n_items = per_prod * n_prod;
+            rbuf_test_locked_t      locked = { .capacity = capacity, .total = n_items };
+            rbuf_test_mpmc_t        mpmc;
+            volatile size_t         n_popped = 0;
+            rbuf_test_mt_ctx_t      ctx = { .mode = mode, .locked = &locked, .mpmc = &mpmc,
+                                            .stamps = stamps, .total = n_items,
+                                            .n_popped = &n_popped, .stop = 0 };
+            size_t                  n_got = 0, sum = 0, sum_ref = 0;
+            unsigned int            n_started = 0, n_cons_started = 0;
+            uint64_t                latency_sum = 0, latency_max = 0;
+            long                    duration;
+
+            if (mode == RBUF_TEST_MT_LOCKED) {
+                if ((locked.rbuf = rbuf_create(capacity, RBF_DEFAULT)) == NULL) {
+                    TEST_CHECK(test, "rbuf_create", 0);
+                    continue ;
+                }
+                pthread_mutex_init(&locked.lock, NULL);
+                pthread_cond_init(&locked.not_empty, NULL);
+                pthread_cond_init(&locked.not_full, NULL);
+            } else if (rbuf_test_mpmc_init(&mpmc, capacity) != 0) {
+                TEST_CHECK(test, "rbuf_test_mpmc_init", 0);
+                continue ;
+            }
+
+            /* producers are started first: the pushes of those which could not be
+             * started are removed from the total before any consumer reads it. */
+            BENCH_TM_START(tm_bench);
+            for (unsigned int i = n_cons; i < n_cons + n_prod; ++i) {
+                jobs_data[i] = (rbuf_test_mt_job_t) { .ctx = &ctx, .first = (i - n_cons) * per_prod,
+                                                 .nb = per_prod };
+                if ((jobs[i] = vjob_run(rbuf_test_mt_producer, &(jobs_data[i]))) == NULL) {
+                    n_items -= per_prod;
+                } else {
+                    sum_ref += per_prod * jobs_data[i].first + (per_prod * (per_prod + 1)) / 2;
+                    ++n_started;
+                }
+            }
+            locked.total = ctx.total = n_items;
+            for (unsigned int i = 0; i < n_cons; ++i) {
+                jobs_data[i] = (rbuf_test_mt_job_t) { .ctx = &ctx, .first = 0, .nb = per_prod };
+                if ((jobs[i] = vjob_run(rbuf_test_mt_consumer, &(jobs_data[i]))) != NULL)
+                    ++n_cons_started;
+            }
+            n_started += n_cons_started;
+            /* without consumers, producers would wait forever for room in the queue */
+            if (n_cons_started == 0) {
+                if (mode == RBUF_TEST_MT_LOCKED)
+                    rbuf_test_locked_stop(&locked);
+                else
+                    __sync_lock_test_and_set(&ctx.stop, 1);
+            }
+            for (unsigned int i = 0; i < n_cons + n_prod; ++i) {
+                if (jobs[i] != NULL)
+                    vjob_waitandfree(jobs[i]);
+                if (i < n_cons) {
+                    n_got += jobs_data[i].n_items;
+                    sum += jobs_data[i].sum;
+                    latency_sum += jobs_data[i].latency_sum;
+                    if (jobs_data[i].latency_max > latency_max)
+                        latency_max = jobs_data[i].latency_max;
+                }
+            }
+            BENCH_TM_STOP(tm_bench);
+            duration = BENCH_TM_GET(tm_bench);
+
+            LOG_INFO(log, "%s %uP%uC: %zu elements in %ld ms (%.0f kops/s), "
+                          "latency avg %.0f ns, max %lu ns",
+                     modes[mode], n_prod, n_cons, n_got, duration,
+                     duration > 0 ? (double) n_got / duration : 0.0,
+                     n_got > 0 ? (double) latency_sum / n_got : 0.0,
+                     (unsigned long) latency_max);
+            TEST_CHECK2(test, "%s %uP%uC: %u/%u jobs started, %zu/%zu elements, checksum %zu",
+                        n_started == n_prod + n_cons && n_got == n_items && sum == sum_ref,
+                        modes[mode], n_prod, n_cons, n_started, n_prod + n_cons,
+                        n_got, n_items, sum);
+
+            if (mode == RBUF_TEST_MT_LOCKED) {
+                pthread_cond_destroy(&locked.not_full);
+                pthread_cond_destroy(&locked.not_empty);
+                pthread_mutex_destroy(&locked.lock);
+                rbuf_free(locked.rbuf);
+            } else {
+                rbuf_test_mpmc_destroy(&mpmc);
+            }
+        }
+    }
+    free(jobs);
+    free(jobs_data);
+    free(stamps);
+}
+
+/* *************** INLINE RECORDS *************** */
+/* Ring buffer storing fixed-size records inline, instead of pointers */
+typedef struct {
+    char *      elts;
+    size_t      elt_size;
+    size_t      max_size;   /* number of records, power of 2 */
+    size_t      head;       /* index of the oldest record */
+    size_t      count;
+} rbuf_test_elt_t;
+
+static rbuf_test_elt_t * rbuf_test_elt_create(size_t max_size, size_t elt_size) {
+    rbuf_test_elt_t *   rbuf;
+    size_t              size = 1;
+
+    while (size < max_size)
+        size <<= 1;
+    if (elt_size == 0 || (rbuf = calloc(1, sizeof(*rbuf))) == NULL)
+        return NULL;
+    if ((rbuf->elts = malloc(size * elt_size)) == NULL) {
+        free(rbuf);
+        return NULL;
+    }
+    rbuf->elt_size = elt_size;
+    rbuf->max_size = size;
+    return rbuf;
+}
+
+static void rbuf_test_elt_free(rbuf_test_elt_t * rbuf) {
+    if (rbuf == NULL)
+        return ;
+    free(rbuf->elts);
+    free(rbuf);
+}
+
+static inline size_t rbuf_test_elt_size(const rbuf_test_elt_t * rbuf) {
+    return rbuf->count;
+}
+
+/* returns the slot of the next record to be written, or NULL if full.
+ * The record is only part of the rbuf after rbuf_test_elt_commit() */
+static inline void * rbuf_test_elt_reserve(rbuf_test_elt_t * rbuf) {
+    if (rbuf->count == rbuf->max_size)
+        return NULL;
+    return rbuf->elts + ((rbuf->head + rbuf->count) & (rbuf->max_size - 1)) * rbuf->elt_size;
+}
+
+static inline void rbuf_test_elt_commit(rbuf_test_elt_t * rbuf) {
+    ++rbuf->count;
+}
+
+/* copies the record elt at the end, returns 0 or -1 if full */
+static inline int rbuf_test_elt_push(rbuf_test_elt_t * rbuf, const void * elt) {
+    void * slot = rbuf_test_elt_reserve(rbuf);
+
+    if (slot == NULL)
+        return -1;
+    memcpy(slot, elt, rbuf->elt_size);
+    rbuf_test_elt_commit(rbuf);
+    return 0;
+}
+
+/* copies the oldest record in out and removes it, returns 0 or -1 if empty */
+static inline int rbuf_test_elt_dequeue(rbuf_test_elt_t * rbuf, void * out) {
+    if (rbuf->count == 0)
+        return -1;
+    memcpy(out, rbuf->elts + rbuf->head * rbuf->elt_size, rbuf->elt_size);
+    rbuf->head = (rbuf->head + 1) & (rbuf->max_size - 1);
+    --rbuf->count;
+    return 0;
+}
+
+/* copies n records from elts at the end with at most two memcpy,
+ * returns the number of records pushed (less than n if full) */
+static size_t rbuf_test_elt_push_n(rbuf_test_elt_t * rbuf, const void * elts, size_t n) {
+    size_t tail = (rbuf->head + rbuf->count) & (rbuf->max_size - 1), first;
+
+    if (n > rbuf->max_size - rbuf->count)
+        n = rbuf->max_size - rbuf->count;
+    first = rbuf->max_size - tail < n ? rbuf->max_size - tail : n;
+    memcpy(rbuf->elts + tail * rbuf->elt_size, elts, first * rbuf->elt_size);
+    memcpy(rbuf->elts, (const char *) elts + first * rbuf->elt_size,
+           (n - first) * rbuf->elt_size);
+    rbuf->count += n;
+    return n;
+}
+
+/* gives the records as at most two contiguous spans, oldest first.
+ * Returns the number of spans, with their start and number of records */
+static unsigned int rbuf_test_elt_peek_segments(const rbuf_test_elt_t * rbuf,
+                                           void * spans[2], size_t counts[2]) {
+    size_t first = rbuf->max_size - rbuf->head;
+
+    if (rbuf->count == 0)
+        return 0;
+    spans[0] = rbuf->elts + rbuf->head * rbuf->elt_size;
+    if (rbuf->count <= first) {
+        counts[0] = rbuf->count;
+        return 1;
+    }
+    counts[0] = first;
+    spans[1] = rbuf->elts;
+    counts[1] = rbuf->count - first;
+    return 2;
+}
+
+/* removes up to n oldest records, copying them to out if not NULL.
+ * Returns the number of records removed */
+static size_t rbuf_test_elt_dequeue_n(rbuf_test_elt_t * rbuf, void * out, size_t n) {
+    void *          spans[2];
+    size_t          counts[2], done = 0;
+    unsigned int    n_spans = rbuf_test_elt_peek_segments(rbuf, spans, counts);
+
+    for (unsigned int i = 0; i < n_spans && done < n; ++i) {
+        size_t count = counts[i] < n - done ? counts[i] : n - done;
+        if (out != NULL)
+            memcpy((char *) out + done * rbuf->elt_size, spans[i], count * rbuf->elt_size);
+        done += count;
+    }
+    rbuf->head = (rbuf->head + done) & (rbuf->max_size - 1);
+    rbuf->count -= done;
+    return done;
+}
+
+typedef struct {
+    uint64_t        time_ms;
+    double          value;
+    unsigned int    id;
+    unsigned int    flags;
+} rbuf_test_sample_t;
+
+static void test_rbuf_elt(const options_test_t * opts, testgroup_t * test) {
+    log_t *             log = test != NULL ? test->log : NULL;
+    const size_t        nb_elts[] = { 100 * 1000, SIZE_MAX, 10 * 1000 * 1000, 0 };
+    const size_t        batch = 512;
+    rbuf_test_elt_t *   rbuf_elt;
+    rbuf_t *            rbuf;
+    rbuf_test_sample_t  sample;
+    size_t              n_errors = 0;
+    unsigned int        n_dequeued = 0;
+    double              sum_ref = 0, sum = 0;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    /* check order and wrap-around */
+    TEST_CHECK(test, "rbuf_test_elt_create",
+               (rbuf_elt = rbuf_test_elt_create(40, sizeof(sample))) != NULL);
+    TEST_CHECK(test, "rbuf_create", (rbuf = rbuf_create(batch, RBF_DEFAULT)) != NULL);
+    if (rbuf_elt == NULL || rbuf == NULL) {
+        rbuf_test_elt_free(rbuf_elt);
+        if (rbuf != NULL)
+            rbuf_free(rbuf);
+        return ;
+    }
+    for (unsigned int i = 0; i < 100; ++i) {
+        sample = (rbuf_test_sample_t) { .time_ms = i, .value = i / 2.0, .id = i };
+        if (rbuf_test_elt_push(rbuf_elt, &sample) != 0)
+            ++n_errors;
+        if (i % 3 != 0 && rbuf_test_elt_dequeue(rbuf_elt, &sample) == 0) {
+            if (sample.id != n_dequeued++)
+                ++n_errors;
+            sum += sample.value;
+        }
+    }
+    TEST_CHECK2(test, "rbuf_test_elt push/dequeue: %zu errors, size %zu, sum %.1f",
+                n_errors == 0 && rbuf_test_elt_size(rbuf_elt) == 100 - 66
+                && sum == (65 * 66 / 2) / 2.0,
+                n_errors, rbuf_test_elt_size(rbuf_elt), sum);
+    /* remaining records, continuing the sequence across the wrap point */
+    while (rbuf_test_elt_dequeue(rbuf_elt, &sample) == 0) {
+        if (sample.id != n_dequeued++)
+            ++n_errors;
+        sum += sample.value;
+    }
+    TEST_CHECK2(test, "rbuf_test_elt drain: %zu errors, %u records, sum %.1f",
+                n_errors == 0 && n_dequeued == 100 && sum == (99 * 100 / 2) / 2.0,
+                n_errors, n_dequeued, sum);
+    rbuf_test_elt_free(rbuf_elt);
+
+    /* streaming records in batches: one malloc per record vs inline records */
+    if ((rbuf_elt = rbuf_test_elt_create(batch, sizeof(sample))) == NULL) {
+        TEST_CHECK(test, "rbuf_test_elt_create", 0);
+        rbuf_free(rbuf);
+        return ;
+    }
+    for (const size_t * p_nb = nb_elts; *p_nb != 0; ++p_nb) {
+        const size_t nb = *p_nb;
+
+        if (nb == SIZE_MAX) { /* after SIZE_MAX this is only for TEST_bigrbuf */
+            if ((opts->test_mode & TEST_MASK(TEST_bigrbuf)) != 0) continue ; else break ;
+        }
+        sum_ref = sum = 0;
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < nb; i += batch) {
+            for (size_t j = i; j < i + batch && j < nb; ++j) {
+                rbuf_test_sample_t * psample = malloc(sizeof(*psample));
+                if (psample == NULL) {
+                    ++n_errors;
+                    continue ;
+                }
+                *psample = (rbuf_test_sample_t) { .time_ms = j, .value = j, .id = j };
+                rbuf_push(rbuf, psample);
+            }
+            while (rbuf_size(rbuf) != 0) {
+                rbuf_test_sample_t * psample = rbuf_dequeue(rbuf);
+                sum_ref += psample->value;
+                free(psample);
+            }
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "rbuf of malloc'ed records x %zu | ", nb);
+
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < nb; i += batch) {
+            for (size_t j = i; j < i + batch && j < nb; ++j) {
+                rbuf_test_sample_t * slot = rbuf_test_elt_reserve(rbuf_elt);
+                if (slot == NULL) {
+                    ++n_errors;
+                    continue ;
+                }
+                *slot = (rbuf_test_sample_t) { .time_ms = j, .value = j, .id = j };
+                rbuf_test_elt_commit(rbuf_elt);
+            }
+            while (rbuf_test_elt_dequeue(rbuf_elt, &sample) == 0) {
+                sum += sample.value;
+            }
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "rbuf_test_elt inline records x %zu | ", nb);
+        TEST_CHECK2(test, "rbuf_test_elt stream: %zu errors, sum %.0f (expected %.0f)",
+                    n_errors == 0 && sum == sum_ref, n_errors, sum, sum_ref);
+    }
+
+    LOG_INFO(log, "rbuf_test_elt MEMORYSIZE = %zu for %zu records",
+             sizeof(*rbuf_elt) + rbuf_elt->max_size * rbuf_elt->elt_size, rbuf_elt->max_size);
+    rbuf_test_elt_free(rbuf_elt);
+    rbuf_free(rbuf);
+}
+
+static void test_rbuf_batch(const options_test_t * opts, testgroup_t * test) {
+    log_t *             log = test != NULL ? test->log : NULL;
+    const size_t        nb_elts[] = { 100 * 1000, SIZE_MAX, 20 * 1000 * 1000, 0 };
+    const size_t        batch = 1000;
+    rbuf_t *            rbuf;
+    rbuf_test_elt_t *   rbuf_elt;
+    void **             buffer;
+    size_t              sums[4] = { 0, 0, 0, 0 }, n_errors = 0;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    /* ring size not multiple of batch, so that spans wrap around */
+    rbuf = rbuf_create(batch + 24, RBF_DEFAULT);
+    rbuf_elt = rbuf_test_elt_create(batch + 24, sizeof(void *));
+    buffer = malloc(batch * sizeof(*buffer));
+    if (rbuf == NULL || rbuf_elt == NULL || buffer == NULL) {
+        TEST_CHECK(test, "rbuf batch bench malloc", 0);
+        if (rbuf != NULL) rbuf_free(rbuf);
+        if (buffer != NULL) free(buffer);
+        rbuf_test_elt_free(rbuf_elt);
+        return ;
+    }
+
+    for (const size_t * p_nb = nb_elts; *p_nb != 0; ++p_nb) {
+        const size_t nb = *p_nb;
+
+        if (nb == SIZE_MAX) { /* after SIZE_MAX this is only for TEST_bigrbuf */
+            if ((opts->test_mode & TEST_MASK(TEST_bigrbuf)) != 0) continue ; else break ;
+        }
+        memset(sums, 0, sizeof(sums));
+        /* one call per element */
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < nb; i += batch) {
+            for (size_t j = 0; j < batch; ++j)
+                rbuf_push(rbuf, (void *) (i + j));
+            for (size_t j = 0; j < batch; ++j)
+                sums[0] += (size_t) rbuf_dequeue(rbuf);
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "rbuf_push+rbuf_dequeue x %zu | ", nb);
+
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < nb; i += batch) {
+            void * data;
+            for (size_t j = 0; j < batch; ++j) {
+                data = (void *) (i + j);
+                rbuf_test_elt_push(rbuf_elt, &data);
+            }
+            for (size_t j = 0; j < batch; ++j) {
+                if (rbuf_test_elt_dequeue(rbuf_elt, &data) == 0)
+                    sums[1] += (size_t) data;
+            }
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log,
+                        "rbuf_test_elt_push+rbuf_test_elt_dequeue x %zu | ", nb);
+
+        /* batches */
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < nb; i += batch) {
+            for (size_t j = 0; j < batch; ++j)
+                buffer[j] = (void *) (i + j);
+            if (rbuf_test_elt_push_n(rbuf_elt, buffer, batch) != batch
+            ||  rbuf_test_elt_dequeue_n(rbuf_elt, buffer, batch) != batch)
+                ++n_errors;
+            for (size_t j = 0; j < batch; ++j)
+                sums[2] += (size_t) buffer[j];
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log,
+                        "rbuf_test_elt_push_n+rbuf_test_elt_dequeue_n(%zu) x %zu | ", batch, nb);
+
+        /* zero-copy consumer: read the spans in place, then drop them */
+        BENCHS_START(tm_bench, cpu_bench);
+        for (size_t i = 0; i < nb; i += batch) {
+            void *          spans[2];
+            size_t          counts[2];
+            unsigned int    n_spans;
+
+            for (size_t j = 0; j < batch; ++j)
+                buffer[j] = (void *) (i + j);
+            if (rbuf_test_elt_push_n(rbuf_elt, buffer, batch) != batch)
+                ++n_errors;
+            n_spans = rbuf_test_elt_peek_segments(rbuf_elt, spans, counts);
+            for (unsigned int s = 0; s < n_spans; ++s) {
+                for (size_t j = 0; j < counts[s]; ++j)
+                    sums[3] += (size_t) ((void **) spans[s])[j];
+            }
+            if (rbuf_test_elt_dequeue_n(rbuf_elt, NULL, batch) != batch)
+                ++n_errors;
+        }
+        BENCHS_STOP_LOG(tm_bench, cpu_bench, log,
+                        "rbuf_test_elt_push_n+peek_segments(%zu) x %zu | ", batch, nb);
+
+        TEST_CHECK2(test, "rbuf batches: %zu errors, sums %zu %zu %zu %zu",
+                    n_errors == 0 && sums[0] == (nb * (nb - 1)) / 2
+                    && sums[1] == sums[0] && sums[2] == sums[0] && sums[3] == sums[0],
+                    n_errors, sums[0], sums[1], sums[2], sums[3]);
+    }
+
+    free(buffer);
+    rbuf_test_elt_free(rbuf_elt);
+    rbuf_free(rbuf);
+}
+
 void * test_rbuf(void * vdata) {
     const options_test_t * opts = (const options_test_t *) vdata;
     testgroup_t *   test = TEST_START(opts->testpool, "RBUF");
@@ -226,6 +904,10 @@ void * test_rbuf(void * vdata) {
     LOG_INFO(log, "rbuf MEMORYSIZE = %zu", rbuf_memorysize(rbuf));
     rbuf_free(rbuf);
 
+    test_rbuf_elt(opts, test);
+    test_rbuf_batch(opts, test);
+    test_rbuf_mt_bench(opts, test);
+
     /* rbuf RBF_OVERWRITE, rbuf_get, rbuf_set */
     LOG_INFO(log, "* rbuf OVERWRITE tests");
     rbuf = rbuf_create(5, RBF_DEFAULT | RBF_OVERWRITE);
@@ -28,6 +28,9 @@
 #ifndef _TEST
 extern int ___nothing___; /* empty */
 #else
+#include <stdlib.h>
+#include <limits.h>
+
 #include "vlib/util.h"
 #include "vlib/slist.h"
 #include "vlib/test.h"
@@ -63,6 +66,409 @@ static int wr_intcmp_sized(const void * a, const void * b) {
     return intcmp((void*)(*((WR_SLIST_DATA_TYPE*)a)), (void*)(*((WR_SLIST_DATA_TYPE*)b)));
 }
 
+/* *************** SLIST NODE POOL *************** */
+/** Node pool for slist: nodes are carved from slabs and recycled through a
+ * freelist, so that building and freeing big lists costs no malloc/free per
+ * node. Pool lists are regular slist_t (SLIST_FOREACH_* apply) but must be
+ * released with slist_test_pool_free(), never with slist_free(). */
+#define SLIST_TEST_POOL_SLAB_NODES  4096
+
+typedef struct slist_test_pool_slab_s {
+    struct slist_test_pool_slab_s * next;
+    slist_t                         nodes[SLIST_TEST_POOL_SLAB_NODES];
+} slist_test_pool_slab_t;
+
+typedef struct {
+    slist_t *                   freelist;
+    slist_test_pool_slab_t *    slabs;
+    size_t                      n_slabs;
+} slist_test_pool_t;
+
+#define SLIST_TEST_POOL_INITIALIZER() { .freelist = NULL, .slabs = NULL, .n_slabs = 0 }
+
+static slist_t * slist_test_pool_node(slist_test_pool_t * pool) {
+    slist_t * node;
+
+    if (pool->freelist == NULL) {
+        slist_test_pool_slab_t * slab = malloc(sizeof(*slab));
+        if (slab == NULL)
+            return NULL;
+        slab->next = pool->slabs;
+        pool->slabs = slab;
+        ++(pool->n_slabs);
+        for (size_t i = 0; i + 1 < SLIST_TEST_POOL_SLAB_NODES; ++i) {
+            slab->nodes[i].next = &(slab->nodes[i + 1]);
+        }
+        slab->nodes[SLIST_TEST_POOL_SLAB_NODES - 1].next = NULL;
+        pool->freelist = slab->nodes;
+    }
+    node = pool->freelist;
+    pool->freelist = node->next;
+    return node;
+}
+
+static slist_t * slist_test_pool_prepend(slist_test_pool_t * pool, slist_t * list, void * data) {
+    slist_t * node = slist_test_pool_node(pool);
+    if (node == NULL)
+        return NULL;
+    node->data = data;
+    node->next = list;
+    return node;
+}
+
+static slist_t * slist_test_pool_appendto(slist_test_pool_t * pool, slist_t * list, void * data,
+                                          slist_t ** plast) {
+    slist_t * node = slist_test_pool_node(pool);
+    if (node == NULL)
+        return NULL;
+    node->data = data;
+    node->next = NULL;
+    if (list == NULL) {
+        list = node;
+    } else {
+        (*plast)->next = node;
+    }
+    *plast = node;
+    return list;
+}
+
+/** give back all nodes of list to the pool (single splice on the freelist) */
+static void slist_test_pool_free(slist_test_pool_t * pool, slist_t * list,
+                                 void (*freefun)(void *)) {
+    slist_t * last = list;
+
+    if (list == NULL)
+        return ;
+    while (1) {
+        if (freefun != NULL)
+            freefun(last->data);
+        if (last->next == NULL)
+            break ;
+        last = last->next;
+    }
+    last->next = pool->freelist;
+    pool->freelist = list;
+}
+
+static void slist_test_pool_destroy(slist_test_pool_t * pool) {
+    while (pool->slabs != NULL) {
+        slist_test_pool_slab_t * slab = pool->slabs;
+        pool->slabs = slab->next;
+        free(slab);
+    }
+    pool->freelist = NULL;
+    pool->n_slabs = 0;
+}
+
+static void test_list_pool_bench(testgroup_t * test, size_t nb, unsigned int cycles) {
+    log_t *         log = test != NULL ? test->log : NULL;
+    slist_test_pool_t    pool = SLIST_TEST_POOL_INITIALIZER();
+    slist_t *       list, * last;
+    size_t          n_errors, sum;
+    const size_t    sum_ref = (nb * (nb - 1)) / 2;
+    BENCHS_DECL(tm_bench, cpu_bench);
+
+    /* slist_prepend + slist_free: one malloc/free per node */
+    n_errors = 0;
+    BENCHS_START(tm_bench, cpu_bench);
+    for (unsigned int c = 0; c < cycles; ++c) {
+        list = NULL;
+        for (size_t i = 0; i < nb; ++i) {
+            slist_t * new = slist_prepend(list, (void *) i);
+            if (new == NULL) {
+                ++n_errors;
+                continue ;
+            }
+            list = new;
+        }
+        sum = 0;
+        SLIST_FOREACH_DATA(list, value, size_t) sum += value;
+        if (sum != sum_ref)
+            ++n_errors;
+        slist_free(list, NULL);
+    }
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "slist_prepend+slist_free %zu nodes x %u | ",
+                    nb, cycles);
+    TEST_CHECK2(test, "slist_prepend cycles: %zu errors", n_errors == 0, n_errors);
+
+    /* slist_appendto + slist_free */
+    n_errors = 0;
+    BENCHS_START(tm_bench, cpu_bench);
+    for (unsigned int c = 0; c < cycles; ++c) {
+        list = last = NULL;
+        for (size_t i = 0; i < nb; ++i) {
+            slist_t * new = slist_appendto(list, (void *) i, &last);
+            if (new == NULL) {
+                ++n_errors;
+                continue ;
+            }
+            list = new;
+        }
+        sum = 0;
+        SLIST_FOREACH_DATA(list, value, size_t) sum += value;
+        if (sum != sum_ref)
+            ++n_errors;
+        slist_free(list, NULL);
+    }
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log, "slist_appendto+slist_free %zu nodes x %u | ",
+                    nb, cycles);
+    TEST_CHECK2(test, "slist_appendto cycles: %zu errors", n_errors == 0, n_errors);
+
+    /* pool: first cycle fills the slabs, next ones only recycle nodes */
+    n_errors = 0;
+    BENCHS_START(tm_bench, cpu_bench);
+    for (unsigned int c = 0; c < cycles; ++c) {
+        list = NULL;
+        for (size_t i = 0; i < nb; ++i) {
+            slist_t * new = slist_test_pool_prepend(&pool, list, (void *) i);
+            if (new == NULL) {
+                ++n_errors;
+                continue ;
+            }
+            list = new;
+        }
+        sum = 0;
+        SLIST_FOREACH_DATA(list, value, size_t) sum += value;
+        if (sum != sum_ref)
+            ++n_errors;
+        slist_test_pool_free(&pool, list, NULL);
+    }
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log,
+                    "slist_test_pool_prepend+slist_test_pool_free %zu nodes x %u | ", nb, cycles);
+    TEST_CHECK2(test, "slist_test_pool_prepend cycles: %zu errors, %zu slabs", n_errors == 0
+                && pool.n_slabs == (nb + SLIST_TEST_POOL_SLAB_NODES - 1)
+                                   / SLIST_TEST_POOL_SLAB_NODES,
+                n_errors, pool.n_slabs);
+
+    n_errors = 0;
+    BENCHS_START(tm_bench, cpu_bench);
+    for (unsigned int c = 0; c < cycles; ++c) {
+        list = last = NULL;
+        for (size_t i = 0; i < nb; ++i) {
+            slist_t * new = slist_test_pool_appendto(&pool, list, (void *) i, &last);
+            if (new == NULL) {
+                ++n_errors;
+                continue ;
+            }
+            list = new;
+        }
+        sum = 0;
+        SLIST_FOREACH_DATA(list, value, size_t) sum += value;
+        if (sum != sum_ref || slist_length(list) != nb)
+            ++n_errors;
+        slist_test_pool_free(&pool, list, NULL);
+    }
+    BENCHS_STOP_LOG(tm_bench, cpu_bench, log,
+                    "slist_test_pool_appendto+slist_test_pool_free %zu nodes x %u | ", nb, cycles);
+    TEST_CHECK2(test, "slist_test_pool_appendto cycles: %zu errors", n_errors == 0, n_errors);
+
+    LOG_INFO(log, "slist_pool MEMORYSIZE = %zu (%zu slabs of %u nodes)",
+             pool.n_slabs * sizeof(slist_test_pool_slab_t), pool.n_slabs,
+             (unsigned int) SLIST_TEST_POOL_SLAB_NODES);
+    slist_test_pool_destroy(&pool);
+}
+
+/* *************** SLIST SORT / MERGE *************** */
+/** stable bottom-up merge sort and merge of slist, without allocation.
+ * The _sized variants give cmpfun a pointer to inline data (SLIST_PDATA),
+ * as slist_insert_sorted_sized() does. */
+#define SLIST_TEST_SORT_DATA(elt, sized)    ((sized) ? SLIST_PDATA(elt) : SLIST_DATA(elt))
+#define SLIST_TEST_SORT_BINS                64
+
+static slist_t * slist_test_merge_sorted_internal(slist_t * a, slist_t * b,
+                                                  slist_cmp_fun_t cmpfun, int sized) {
+    slist_t     head, * tail = &head;
+
+    while (a != NULL && b != NULL) {
+        /* on equality take from a first: keeps merge stable */
+        if (cmpfun(SLIST_TEST_SORT_DATA(a, sized), SLIST_TEST_SORT_DATA(b, sized)) <= 0) {
+            tail->next = a;
+            a = a->next;
+        } else {
+            tail->next = b;
+            b = b->next;
+        }
+        tail = tail->next;
+    }
+    tail->next = (a != NULL ? a : b);
+    return head.next;
+}
+
+static slist_t * slist_test_sort_internal(slist_t * list, slist_cmp_fun_t cmpfun, int sized) {
+    /* bins[i] holds a sorted run of 2^i nodes, older than runs of lower bins */
+    slist_t *       bins[SLIST_TEST_SORT_BINS];
+    unsigned int    n_bins = 0, i;
+
+    while (list != NULL) {
+        slist_t * run = list;
+        list = list->next;
+        run->next = NULL;
+        for (i = 0; i + 1 < SLIST_TEST_SORT_BINS && i < n_bins && bins[i] != NULL; ++i) {
+            run = slist_test_merge_sorted_internal(bins[i], run, cmpfun, sized);
+            bins[i] = NULL;
+        }
+        if (i >= n_bins) {
+            n_bins = i + 1;
+        }
+        bins[i] = run;
+    }
+    for (i = 0; i < n_bins; ++i) {
+        if (bins[i] != NULL)
+            list = slist_test_merge_sorted_internal(bins[i], list, cmpfun, sized);
+    }
+    return list;
+}
+
+static slist_t * slist_test_sort(slist_t * list, slist_cmp_fun_t cmpfun) {
+    return slist_test_sort_internal(list, cmpfun, 0);
+}
+static slist_t * slist_test_sort_sized(slist_t * list, slist_cmp_fun_t cmpfun) {
+    return slist_test_sort_internal(list, cmpfun, 1);
+}
+static slist_t * slist_test_merge_sorted(slist_t * a, slist_t * b, slist_cmp_fun_t cmpfun) {
+    return slist_test_merge_sorted_internal(a, b, cmpfun, 0);
+}
+static slist_t * slist_test_merge_sorted_sized(slist_t * a, slist_t * b, slist_cmp_fun_t cmpfun) {
+    return slist_test_merge_sorted_internal(a, b, cmpfun, 1);
+}
+
+typedef struct {
+    long    key;
+    long    seq;
+} test_list_pair_t;
+
+static int test_list_paircmp(const void * a, const void * b) {
+    long ka = ((const test_list_pair_t *) a)->key, kb = ((const test_list_pair_t *) b)->key;
+    return ka < kb ? -1 : (ka > kb ? 1 : 0);
+}
+
+static int test_list_check_sorted(slist_t * list, size_t nb) {
+    size_t  n = 0;
+    long    prev = LONG_MIN;
+
+    SLIST_FOREACH_DATA(list, value, long) {
+        if (value < prev)
+            return 0;
+        prev = value;
+        ++n;
+    }
+    return n == nb;
+}
+
+static void test_list_sort(const options_test_t * opts, testgroup_t * test) {
+    log_t *             log = test != NULL ? test->log : NULL;
+    const size_t        sizes[] = { 4, 16, 64, 256, 1024, SIZE_MAX, 4096, 16384, 0 };
+    const size_t        total = 64 * 1024;
+    slist_t *           list, * list2;
+    test_list_pair_t    pair;
+    size_t              n_errors = 0, crossover = 0;
+    long                prev_key, prev_seq;
+    BENCH_TM_DECL(tm_bench);
+
+    /* stability of slist_test_sort_sized: equal keys must keep insertion order */
+    list = NULL;
+    for (long i = 0; i < 1000; ++i) {
+        pair = (test_list_pair_t) { .key = (i * 7919) % 13, .seq = i };
+        list = slist_prepend_sized(list, &pair, sizeof(pair));
+    }
+    list = slist_test_sort_sized(list, test_list_paircmp);
+    prev_key = -1;
+    prev_seq = 0;
+    SLIST_FOREACH_PDATA(list, ppair, test_list_pair_t *) {
+        if (ppair->key < prev_key || (ppair->key == prev_key && ppair->seq > prev_seq))
+            ++n_errors;
+        prev_key = ppair->key;
+        prev_seq = ppair->seq;
+    }
+    TEST_CHECK2(test, "slist_test_sort_sized stable: %zu errors, length %u",
+                n_errors == 0 && slist_length(list) == 1000, n_errors, slist_length(list));
+
+    /* slist_test_merge_sorted_sized of odd and even keys */
+    list2 = NULL;
+    for (long i = 999; i >= 0; --i) {
+        pair = (test_list_pair_t) { .key = 2 * i + 1, .seq = i };
+        list2 = slist_prepend_sized(list2, &pair, sizeof(pair));
+    }
+    slist_free(list, NULL);
+    list = NULL;
+    for (long i = 999; i >= 0; --i) {
+        pair = (test_list_pair_t) { .key = 2 * i, .seq = i };
+        list = slist_prepend_sized(list, &pair, sizeof(pair));
+    }
+    list = slist_test_merge_sorted_sized(list, list2, test_list_paircmp);
+    n_errors = 0;
+    prev_key = -1;
+    SLIST_FOREACH_PDATA(list, ppair, test_list_pair_t *) {
+        if (ppair->key != prev_key + 1)
+            ++n_errors;
+        prev_key = ppair->key;
+    }
+    TEST_CHECK2(test, "slist_test_merge_sorted_sized: %zu errors, last %ld",
+                n_errors == 0 && prev_key == 1999, n_errors, prev_key);
+    slist_free(list, NULL);
+
+    /* edge cases */
+    TEST_CHECK(test, "slist_test_sort(NULL)", slist_test_sort(NULL, intcmp) == NULL);
+    list = slist_test_sort(slist_prepend(NULL, (void *) 1L), intcmp);
+    TEST_CHECK(test, "slist_test_sort(1 elt)", test_list_check_sorted(list, 1));
+    list = slist_test_merge_sorted(list, NULL, intcmp);
+    TEST_CHECK(test, "slist_test_merge_sorted(l, NULL)", test_list_check_sorted(list, 1));
+    slist_free(list, NULL);
+
+    /* crossover: repeated slist_insert_sorted (O(n^2)) vs prepend + slist_test_sort */
+    for (size_t i_sz = 0; sizes[i_sz] != 0; ++i_sz) {
+        size_t          nb = sizes[i_sz], reps;
+        unsigned long   tm_insert, tm_sort;
+        long *          values;
+
+        if (nb == SIZE_MAX) { /* after size max this is only for TEST_biglist */
+            if ((opts->test_mode & TEST_MASK(TEST_biglist)) != 0) continue ; else break ;
+        }
+        reps = total / nb;
+
+        if ((values = malloc(nb * sizeof(*values))) == NULL) {
+            TEST_CHECK(test, "malloc", 0);
+            break ;
+        }
+        for (size_t i = 0; i < nb; ++i)
+            values[i] = rand() % (nb * 4);
+
+        BENCH_TM_START(tm_bench);
+        for (size_t r = 0; r < reps; ++r) {
+            list = NULL;
+            for (size_t i = 0; i < nb; ++i)
+                list = slist_insert_sorted(list, (void *) values[i], intcmp);
+            if (r + 1 < reps)
+                slist_free(list, NULL);
+        }
+        BENCH_TM_STOP(tm_bench);
+        tm_insert = BENCH_TM_GET_US(tm_bench);
+        TEST_CHECK2(test, "slist_insert_sorted x %zu sorted", test_list_check_sorted(list, nb), nb);
+        slist_free(list, NULL);
+
+        BENCH_TM_START(tm_bench);
+        for (size_t r = 0; r < reps; ++r) {
+            list = NULL;
+            for (size_t i = 0; i < nb; ++i)
+                list = slist_prepend(list, (void *) values[i]);
+            list = slist_test_sort(list, intcmp);
+            if (r + 1 < reps)
+                slist_free(list, NULL);
+        }
+        BENCH_TM_STOP(tm_bench);
+        tm_sort = BENCH_TM_GET_US(tm_bench);
+        TEST_CHECK2(test, "slist_test_sort x %zu sorted", test_list_check_sorted(list, nb), nb);
+        slist_free(list, NULL);
+        free(values);
+
+        if (crossover == 0 && tm_sort < tm_insert)
+            crossover = nb;
+        LOG_INFO(log, "slist sorted build of %zu elts (x%zu): insert_sorted %lu us, "
+                      "prepend+sort %lu us", nb, reps, tm_insert, tm_sort);
+    }
+    LOG_INFO(log, "slist_test_sort faster than repeated insert_sorted from %zu elts", crossover);
+}
+
 void * test_list(void * vdata) {
     const options_test_t * opts = (const options_test_t *) vdata;
     testgroup_t *   test = TEST_START(opts->testpool, "LIST");
@@ -70,6 +476,7 @@ void * test_list(void * vdata) {
     slist_t *       list;
     const int       ints[] = { 2, 9, 4, 5, 8, 3, 6, 7, 4, 1 };
     const size_t    intssz = sizeof(ints)/sizeof(*ints);
+    const size_t    pool_sizes[] = { 100 * 1000, SIZE_MAX, 1000 * 1000, 0 };
     long            prev;
     FILE *          out;
 
@@ -188,6 +595,17 @@ void * test_list(void * vdata) {
         wr_cmpfun = wr_intcmp_sized;
     }
 
+    /* bulk sort and merge */
+    test_list_sort(opts, test);
+
+    /* build/free cycles of big lists */
+    for (const size_t * nb = pool_sizes; *nb != 0; nb++) {
+        if (*nb == SIZE_MAX) { /* after size max this is only for TEST_biglist */
+            if ((opts->test_mode & TEST_MASK(TEST_biglist)) != 0) continue ; else break ;
+        }
+        test_list_pool_bench(test, *nb, 10);
+    }
+
     return VOIDP(TEST_END(test));
 }
 
@@ -46,10 +46,12 @@ extern int ___nothing___; /* empty */
 #include <pwd.h>
 #include <grp.h>
 #include <math.h>
+#include <time.h>
 
 #include "vlib/util.h"
 #include "vlib/time.h"
 #include "vlib/thread.h"
+#include "vlib/job.h"
 #include "vlib/logpool.h"
 #include "vlib/test.h"
 
@@ -219,6 +221,384 @@ static void * test_vthread_stop(vthread_t * vthread, int imod) {
     }
 }
 
+// *****************************************************************************
+// cooperative tasks on a vthread
+// *****************************************************************************
+/* A task is a resumable state machine: step() runs until the task must wait,
+ * then returns what it awaits (fd readable or timer). The fd of each task is
+ * registered once on the vthread with VTE_FD_READ, timers are checked at each
+ * loop by a VTE_PROCESS_START callback. A task costs sizeof(test_vtask_t)
+ * plus its data, no stack: one vthread multiplexes all in-flight reads.
+ * Awaiting a job is done by awaiting a fd written by the job. */
+typedef enum {
+    TEST_VTASK_AWAIT_FD = 0,
+    TEST_VTASK_AWAIT_TIMER,
+    TEST_VTASK_DONE,
+} test_vtask_await_t;
+
+typedef struct test_vtask_sched_s test_vtask_sched_t;
+typedef struct test_vtask_s test_vtask_t;
+
+struct test_vtask_s {
+    test_vtask_await_t      (*step)(test_vtask_t * task);
+    test_vtask_sched_t *    sched;
+    int                     state;          /* resume point of step() */
+    int                     fd;             /* awaited by TEST_VTASK_AWAIT_FD */
+    test_vtask_await_t      await;
+    uint64_t                deadline_ns;    /* awaited by TEST_VTASK_AWAIT_TIMER */
+    void *                  data;
+};
+
+struct test_vtask_sched_s {
+    test_vtask_t *      tasks;
+    unsigned int        n_tasks;
+    unsigned int        n_done;
+    unsigned long       n_resumes;
+    pthread_mutex_t     lock;           /* n_done, signaled on task completion */
+    pthread_cond_t      cond;
+};
+
+static inline uint64_t test_vtask_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000UL + ts.tv_nsec;
+}
+
+static void test_vtask_resume(test_vtask_t * task) {
+    test_vtask_sched_t * sched = task->sched;
+
+    ++sched->n_resumes;
+    if ((task->await = task->step(task)) == TEST_VTASK_DONE) {
+        pthread_mutex_lock(&sched->lock);
+        ++sched->n_done;
+        pthread_cond_signal(&sched->cond);
+        pthread_mutex_unlock(&sched->lock);
+    }
+}
+
+static int test_vtask_fd_callback(
+        vthread_t *             vthread,
+        vthread_event_t         event,
+        void *                  event_data,
+        void *                  callback_user_data) {
+    test_vtask_t * task = (test_vtask_t *) callback_user_data;
+    (void) vthread;
+    (void) event;
+    (void) event_data;
+
+    if (task->await == TEST_VTASK_AWAIT_FD)
+        test_vtask_resume(task);
+    return 0;
+}
+
+static int test_vtask_tick_callback(
+        vthread_t *             vthread,
+        vthread_event_t         event,
+        void *                  event_data,
+        void *                  callback_user_data) {
+    test_vtask_sched_t * sched = (test_vtask_sched_t *) callback_user_data;
+    uint64_t        now = test_vtask_now_ns();
+    (void) vthread;
+    (void) event;
+    (void) event_data;
+
+    for (unsigned int i = 0; i < sched->n_tasks; ++i) {
+        test_vtask_t * task = &(sched->tasks[i]);
+        if (task->await == TEST_VTASK_AWAIT_TIMER && task->deadline_ns <= now)
+            test_vtask_resume(task);
+    }
+    return 0;
+}
+
+/* waits until all tasks are done or timeout, returns number of tasks done */
+static unsigned int test_vtask_sched_wait(test_vtask_sched_t * sched, unsigned int timeout_ms) {
+    struct timespec ts;
+    unsigned int    n_done;
+
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += timeout_ms / 1000;
+    ts.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ++ts.tv_sec;
+        ts.tv_nsec -= 1000000000L;
+    }
+    pthread_mutex_lock(&sched->lock);
+    while (sched->n_done < sched->n_tasks
+           && pthread_cond_timedwait(&sched->cond, &sched->lock, &ts) != ETIMEDOUT)
+        ; /* nothing but loop */
+    n_done = sched->n_done;
+    pthread_mutex_unlock(&sched->lock);
+    return n_done;
+}
+
+/* simulated slow device (sysfs/procfs file): answers a read request on the
+ * requester fd after a fixed latency. Requests are served in order, as all
+ * have the same latency. */
+typedef struct {
+    int                 fd;
+    long                value;
+    uint64_t            due_ns;
+} test_vtask_devreq_t;
+
+typedef struct {
+    pthread_mutex_t         lock;
+    pthread_cond_t          cond;
+    test_vtask_devreq_t *   reqs;
+    size_t                  size;
+    size_t                  head;
+    size_t                  count;
+    uint64_t                latency_ns;
+    int                     stop;
+} test_vtask_device_t;
+
+static int test_vtask_device_request(test_vtask_device_t * dev, int fd, long value) {
+    int ret = -1;
+
+    pthread_mutex_lock(&dev->lock);
+    if (dev->count < dev->size) {
+        dev->reqs[(dev->head + dev->count++) % dev->size] = (test_vtask_devreq_t) {
+            .fd = fd, .value = value, .due_ns = test_vtask_now_ns() + dev->latency_ns };
+        pthread_cond_signal(&dev->cond);
+        ret = 0;
+    }
+    pthread_mutex_unlock(&dev->lock);
+    return ret;
+}
+
+static void * test_vtask_device_job(void * vdata) {
+    test_vtask_device_t *   dev = (test_vtask_device_t *) vdata;
+    test_vtask_devreq_t     req;
+    uint64_t                now;
+
+    pthread_mutex_lock(&dev->lock);
+    while (1) {
+        while (dev->count == 0 && !dev->stop)
+            pthread_cond_wait(&dev->cond, &dev->lock);
+        if (dev->count == 0)
+            break ;
+        req = dev->reqs[dev->head];
+        dev->head = (dev->head + 1) % dev->size;
+        --dev->count;
+        pthread_mutex_unlock(&dev->lock);
+        if ((now = test_vtask_now_ns()) < req.due_ns) {
+            struct timespec ts = { .tv_sec = (req.due_ns - now) / 1000000000UL,
+                                   .tv_nsec = (req.due_ns - now) % 1000000000UL };
+            while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+                ; /* nothing but loop */
+        }
+        while (write(req.fd, &req.value, sizeof(req.value)) < 0 && errno == EINTR)
+            ; /* nothing but loop */
+        pthread_mutex_lock(&dev->lock);
+    }
+    pthread_mutex_unlock(&dev->lock);
+    return NULL;
+}
+
+/* a sensor reading the device every period, n_rounds times */
+typedef struct {
+    test_vtask_device_t *   dev;
+    unsigned int            id;
+    unsigned int            round;
+    unsigned int            n_rounds;
+    uint64_t                period_ns;
+    int                     fd_in;
+    int                     fd_out;
+    unsigned long           sum;
+    unsigned int            n_errors;
+} test_vtask_sensor_t;
+
+#define TEST_VTASK_SENSOR_VALUE(sensor) ((long) (sensor)->id * 1000 + (sensor)->round)
+
+static test_vtask_await_t test_vtask_sensor_step(test_vtask_t * task) {
+    test_vtask_sensor_t *   sensor = (test_vtask_sensor_t *) task->data;
+    long                    value;
+    ssize_t                 ret;
+
+    switch (task->state) {
+        case 0: /* request a read */
+            if (test_vtask_device_request(sensor->dev, sensor->fd_out,
+                                          TEST_VTASK_SENSOR_VALUE(sensor)) != 0) {
+                ++sensor->n_errors;
+                return TEST_VTASK_DONE;
+            }
+            task->state = 1;
+            return TEST_VTASK_AWAIT_FD;
+        case 1: /* read result, then wait for next period */
+            if ((ret = read(task->fd, &value, sizeof(value))) < 0
+            &&  (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)) {
+                return TEST_VTASK_AWAIT_FD;
+            }
+            if (ret != sizeof(value) || value != TEST_VTASK_SENSOR_VALUE(sensor)) {
+                ++sensor->n_errors;
+            } else {
+                sensor->sum += value;
+            }
+            if (++sensor->round >= sensor->n_rounds) {
+                task->state = 2;
+                return TEST_VTASK_DONE;
+            }
+            task->deadline_ns = test_vtask_now_ns() + sensor->period_ns;
+            task->state = 0;
+            return TEST_VTASK_AWAIT_TIMER;
+        default:
+            return TEST_VTASK_DONE;
+    }
+}
+
+/* same sensor, blocking, for the thread per read baseline */
+static void * test_vtask_sensor_job(void * vdata) {
+    test_vtask_sensor_t *   sensor = (test_vtask_sensor_t *) vdata;
+    long                    value;
+    ssize_t                 ret;
+
+    for (sensor->round = 0; sensor->round < sensor->n_rounds; ++sensor->round) {
+        if (sensor->round > 0)
+            usleep(sensor->period_ns / 1000);
+        if (test_vtask_device_request(sensor->dev, sensor->fd_out,
+                                      TEST_VTASK_SENSOR_VALUE(sensor)) != 0) {
+            ++sensor->n_errors;
+            break ;
+        }
+        while ((ret = read(sensor->fd_in, &value, sizeof(value))) < 0 && errno == EINTR)
+            ; /* nothing but loop */
+        if (ret != sizeof(value) || value != TEST_VTASK_SENSOR_VALUE(sensor)) {
+            ++sensor->n_errors;
+        } else {
+            sensor->sum += value;
+        }
+    }
+    return NULL;
+}
+
+static void test_vtask(testgroup_t * test, log_t * log) {
+    const unsigned int      n_tasks = 128, n_rounds = 5, period_ms = 10, tick_ms = 2;
+    test_vtask_sched_t      sched = { .n_tasks = n_tasks, .n_done = 0, .n_resumes = 0 };
+    test_vtask_device_t     dev = { .size = n_tasks, .head = 0, .count = 0,
+                               .latency_ns = 2 * 1000000UL, .stop = 0 };
+    test_vtask_sensor_t *   sensors;
+    vjob_t *                dev_job;
+    vjob_t **               jobs;
+    vthread_t *             vthread = NULL;
+    unsigned long           sum, sum_ref = 0;
+    unsigned int            n_errors = 0, n_done = 0, n_pipes = 0;
+    BENCH_TM_DECL(t);
+
+    LOG_INFO(log, "cooperative tasks: %u sensors x %u reads, period %u ms",
+             n_tasks, n_rounds, period_ms);
+    sensors = calloc(n_tasks, sizeof(*sensors));
+    sched.tasks = calloc(n_tasks, sizeof(*sched.tasks));
+    dev.reqs = calloc(n_tasks, sizeof(*dev.reqs));
+    jobs = calloc(n_tasks, sizeof(*jobs));
+    if (sensors == NULL || sched.tasks == NULL || dev.reqs == NULL || jobs == NULL) {
+        TEST_CHECK(test, "vtask alloc", 0);
+        free(sensors); free(sched.tasks); free(dev.reqs); free(jobs);
+        return ;
+    }
+    pthread_mutex_init(&sched.lock, NULL);
+    pthread_cond_init(&sched.cond, NULL);
+    pthread_mutex_init(&dev.lock, NULL);
+    pthread_cond_init(&dev.cond, NULL);
+
+    for (n_pipes = 0; n_pipes < n_tasks; ++n_pipes) {
+        test_vtask_sensor_t *   sensor = &(sensors[n_pipes]);
+        int                     pipefd[2];
+
+        if (pipe(pipefd) != 0)
+            break ;
+        *sensor = (test_vtask_sensor_t) { .dev = &dev, .id = n_pipes, .n_rounds = n_rounds,
+                                          .period_ns = period_ms * 1000000UL,
+                                          .fd_in = pipefd[0], .fd_out = pipefd[1] };
+        for (unsigned int r = 0; r < n_rounds; ++r)
+            sum_ref += (long) n_pipes * 1000 + r;
+    }
+    TEST_CHECK2(test, "vtask: create %u pipes", n_pipes == n_tasks, n_tasks);
+    TEST_CHECK(test, "vtask: start device",
+               (dev_job = vjob_run(test_vtask_device_job, &dev)) != NULL);
+
+    /* one vthread, all reads as tasks */
+    TEST_CHECK(test, "vtask: vthread_create", n_pipes == n_tasks
+               && (vthread = vthread_create(tick_ms, log)) != NULL);
+    if (vthread != NULL && dev_job != NULL) {
+        for (unsigned int i = 0; i < n_tasks; ++i) {
+            fcntl(sensors[i].fd_in, F_SETFL, fcntl(sensors[i].fd_in, F_GETFL) | O_NONBLOCK);
+            sched.tasks[i] = (test_vtask_t) { .step = test_vtask_sensor_step, .sched = &sched,
+                                         .state = 0, .fd = sensors[i].fd_in,
+                                         .await = TEST_VTASK_AWAIT_TIMER, .deadline_ns = 0,
+                                         .data = &(sensors[i]) };
+            if (vthread_register_event(vthread, VTE_FD_READ, VTE_DATA_FD(sensors[i].fd_in),
+                                       test_vtask_fd_callback, &(sched.tasks[i])) != 0)
+                ++n_errors;
+        }
+        if (vthread_register_event(vthread, VTE_PROCESS_START, NULL,
+                                   test_vtask_tick_callback, &sched) != 0)
+            ++n_errors;
+        TEST_CHECK2(test, "vtask: register events (%u errors)", n_errors == 0, n_errors);
+
+        BENCH_TM_START(t);
+        TEST_CHECK(test, "vtask: vthread_start", vthread_start(vthread) == 0);
+        n_done = test_vtask_sched_wait(&sched, 10000);
+        BENCH_TM_STOP(t);
+        TEST_CHECK(test, "vtask: vthread_stop", vthread_stop(vthread) == VTHREAD_RESULT_OK);
+
+        sum = 0;
+        n_errors = 0;
+        for (unsigned int i = 0; i < n_tasks; ++i) {
+            sum += sensors[i].sum;
+            n_errors += sensors[i].n_errors;
+        }
+        LOG_INFO(log, "vtask: %u/%u tasks done in %ld ms on 1 vthread, %lu resumes, "
+                      "%zu bytes/task", n_done, n_tasks, BENCH_TM_GET(t), sched.n_resumes,
+                 sizeof(test_vtask_t) + sizeof(test_vtask_sensor_t));
+        TEST_CHECK2(test, "vtask: %u/%u done, %u errors, sum %lu (expected %lu)",
+                    n_done == n_tasks && n_errors == 0 && sum == sum_ref,
+                    n_done, n_tasks, n_errors, sum, sum_ref);
+
+        /* baseline: one thread per sensor, blocking reads */
+        n_errors = 0;
+        BENCH_TM_START(t);
+        for (unsigned int i = 0; i < n_tasks; ++i) {
+            fcntl(sensors[i].fd_in, F_SETFL, fcntl(sensors[i].fd_in, F_GETFL) & ~O_NONBLOCK);
+            sensors[i].sum = 0;
+            sensors[i].n_errors = 0;
+            if ((jobs[i] = vjob_run(test_vtask_sensor_job, &(sensors[i]))) == NULL)
+                ++n_errors;
+        }
+        sum = 0;
+        for (unsigned int i = 0; i < n_tasks; ++i) {
+            if (jobs[i] != NULL)
+                vjob_waitandfree(jobs[i]);
+            sum += sensors[i].sum;
+            n_errors += sensors[i].n_errors;
+        }
+        BENCH_TM_STOP(t);
+        LOG_INFO(log, "vtask: thread per sensor: %u threads in %ld ms", n_tasks, BENCH_TM_GET(t));
+        TEST_CHECK2(test, "vtask: thread per sensor: %u errors, sum %lu (expected %lu)",
+                    n_errors == 0 && sum == sum_ref, n_errors, sum, sum_ref);
+    } else if (vthread != NULL) {
+        vthread_stop(vthread);
+    }
+
+    if (dev_job != NULL) {
+        pthread_mutex_lock(&dev.lock);
+        dev.stop = 1;
+        pthread_cond_signal(&dev.cond);
+        pthread_mutex_unlock(&dev.lock);
+        vjob_waitandfree(dev_job);
+    }
+    for (unsigned int i = 0; i < n_pipes; ++i) {
+        close(sensors[i].fd_in);
+        close(sensors[i].fd_out);
+    }
+    pthread_cond_destroy(&dev.cond);
+    pthread_mutex_destroy(&dev.lock);
+    pthread_cond_destroy(&sched.cond);
+    pthread_mutex_destroy(&sched.lock);
+    free(jobs);
+    free(dev.reqs);
+    free(sched.tasks);
+    free(sensors);
+}
+
 void * test_thread(void * vdata) {
     const options_test_t * opts = (const options_test_t *) vdata;
     testgroup_t *   test            = TEST_START(opts->testpool, "VTHREAD");
@@ -499,6 +879,9 @@ void * test_thread(void * vdata) {
                  all_pipectx[0].nb_ok, all_pipectx[0].nb_bigok);
     }
 
+    /* **** */
+    test_vtask(test, log);
+
     return VOIDP(TEST_END(test) + (test == NULL && bench == 0
                                    ? 1 + all_pipectx[0].nb_error : 0));
 }
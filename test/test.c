@@ -34,9 +34,11 @@ extern int ___nothing___; /* empty */
 #include <stdlib.h>
 #include <fcntl.h>
 #include <sys/time.h>
+#include <time.h>
 #include <sys/select.h>
 #include <signal.h>
 #include <pthread.h>
+#include <sched.h>
 #include <errno.h>
 #include <ctype.h>
 #include <stdint.h>
@@ -128,6 +130,9 @@ static const struct {
     { "optusage_stdout",    test_optusage_stdout, TEST_MASK_ALL },
     { "logpool_big",        NULL,               0 },
     { "bighash",            NULL,               0 },
+    { "bigrbuf",            NULL,               0 },
+    { "biglist",            NULL,               0 },
+    { "bigjob",             NULL,               0 },
     { "PARALLEL",           NULL,               0 },
     { NULL, NULL, 0 } /* Must be last */
 };
@@ -253,22 +258,254 @@ int intcmp(const void * a, const void *b) {
     return (long)a - (long)b;
 }
 
+/* reads one integer from a /sys file whose path is fmt formatted with id */
+static int test_topo_read_int(const char * fmt, int id, long * value) {
+    char    path[128];
+    FILE *  file;
+    int     ret;
+
+    snprintf(path, sizeof(path), fmt, id);
+    if ((file = fopen(path, "r")) == NULL)
+        return -1;
+    ret = fscanf(file, "%ld", value) == 1 ? 0 : -1;
+    fclose(file);
+    return ret;
+}
+
+/* reads a /sys cpu list such as '0-3,8-11'. With cpus == NULL, returns the number of
+ * cpus in the list, otherwise stores at most max of them in cpus. -1 on error */
+static int test_topo_read_cpulist(const char * path, int * cpus, unsigned int max) {
+    FILE *  file;
+    long    first, last;
+    int     c, n = 0;
+
+    if ((file = fopen(path, "r")) == NULL)
+        return -1;
+    while (fscanf(file, "%ld", &first) == 1) {
+        last = first;
+        if ((c = fgetc(file)) == '-') {
+            if (fscanf(file, "%ld", &last) != 1) {
+                n = -1;
+                break ;
+            }
+            c = fgetc(file);
+        }
+        for (long cpu = first; cpu >= 0 && cpu <= last; ++cpu, ++n) {
+            if (cpus != NULL && (unsigned int) n < max)
+                cpus[n] = cpu;
+        }
+        if (c != ',')
+            break ;
+    }
+    fclose(file);
+    return n;
+}
+
+/* index of cpu id in topo->cpu_id[], or -1 */
+static int test_topo_cpu_index(const test_topo_t * topo, long cpu) {
+    for (unsigned int i = 0; i < topo->n_cpus; ++i) {
+        if (topo->cpu_id[i] == cpu)
+            return i;
+    }
+    return -1;
+}
+
+void test_topo_free(test_topo_t * topo) {
+    free(topo->cpu_id);
+    free(topo->cpu_core);
+    free(topo->cpu_node);
+    free(topo->core_cpu);
+    topo->cpu_id = topo->cpu_core = topo->cpu_node = topo->core_cpu = NULL;
+    topo->n_cpus = topo->n_cores = 0;
+}
+
+/* default topology: cpus 0..n-1, each one a core of node 0 */
+static void test_topo_default(test_topo_t * topo) {
+    topo->n_cores = topo->n_cpus;
+    topo->n_nodes = 1;
+    for (unsigned int i = 0; i < topo->n_cpus; ++i) {
+        topo->cpu_id[i] = topo->core_cpu[i] = i;
+        topo->cpu_core[i] = i;
+        topo->cpu_node[i] = 0;
+    }
+}
+
+/* reads the online cpus, their physical core and numa node from /sys (linux).
+ * If any of it cannot be read, the whole topology is the default one */
+int test_topo_get(test_topo_t * topo) {
+    long *  core_keys;
+    int     n_online, n_sys;
+
+    n_online = test_topo_read_cpulist("/sys/devices/system/cpu/online", NULL, 0);
+    n_sys = n_online;
+    if (n_online <= 0)
+        n_online = vjob_cpu_nb() > 0 ? vjob_cpu_nb() : 1;
+    topo->n_cpus = n_online;
+    topo->n_cores = 0;
+    topo->n_nodes = 1;
+    topo->cpu_id = calloc(topo->n_cpus, sizeof(*topo->cpu_id));
+    topo->cpu_core = calloc(topo->n_cpus, sizeof(*topo->cpu_core));
+    topo->cpu_node = calloc(topo->n_cpus, sizeof(*topo->cpu_node));
+    topo->core_cpu = calloc(topo->n_cpus, sizeof(*topo->core_cpu));
+    core_keys = calloc(topo->n_cpus, sizeof(*core_keys));
+    if (topo->cpu_id == NULL || topo->cpu_core == NULL || topo->cpu_node == NULL
+    ||  topo->core_cpu == NULL || core_keys == NULL) {
+        free(core_keys);
+        test_topo_free(topo);
+        return -1;
+    }
+    if (n_sys <= 0 || test_topo_read_cpulist("/sys/devices/system/cpu/online",
+                                             topo->cpu_id, topo->n_cpus) != n_sys) {
+        free(core_keys);
+        test_topo_default(topo);
+        return 1;
+    }
+    /* a physical core is a (package, core_id) pair: its first cpu is its
+     * primary thread, next ones are its smt siblings */
+    for (unsigned int i = 0; i < topo->n_cpus; ++i) {
+        long package, core_id, key;
+        unsigned int core;
+
+        if (test_topo_read_int("/sys/devices/system/cpu/cpu%d/topology/physical_package_id",
+                               topo->cpu_id[i], &package) != 0
+        ||  test_topo_read_int("/sys/devices/system/cpu/cpu%d/topology/core_id",
+                               topo->cpu_id[i], &core_id) != 0) {
+            free(core_keys);
+            test_topo_default(topo);
+            return 1;
+        }
+        key = (package << 20) | core_id;
+        for (core = 0; core < topo->n_cores && core_keys[core] != key; ++core)
+            ; /* nothing but loop */
+        if (core == topo->n_cores) {
+            core_keys[topo->n_cores] = key;
+            topo->core_cpu[topo->n_cores++] = i;
+        }
+        topo->cpu_core[i] = core;
+    }
+    free(core_keys);
+    /* numa nodes: /sys/devices/system/node/nodeN/cpulist. Without node0, all is node 0 */
+    for (unsigned int node = 0; /* no_check */; ++node) {
+        char    path[128];
+        int *   node_cpus;
+        int     n;
+
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%u/cpulist", node);
+        if ((n = test_topo_read_cpulist(path, NULL, 0)) < 0)
+            break ;
+        if ((node_cpus = malloc((n > 0 ? n : 1) * sizeof(*node_cpus))) == NULL
+        ||  test_topo_read_cpulist(path, node_cpus, n) != n) {
+            free(node_cpus);
+            test_topo_default(topo);
+            return 1;
+        }
+        for (int j = 0, i; j < n; ++j) {
+            if ((i = test_topo_cpu_index(topo, node_cpus[j])) >= 0)
+                topo->cpu_node[i] = node;
+        }
+        free(node_cpus);
+        topo->n_nodes = node + 1;
+    }
+    return 0;
+}
+
+/* pins the calling thread on one cpu */
+int test_cpu_pin(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? 0 : -1;
+#else
+    (void) cpu;
+    errno = ENOTSUP;
+    return -1;
+#endif
+}
+
+/* fills cpus[n_workers] with cpu ids according to placement, returns NULL for PIN_NONE */
+int * test_topo_placement(const test_topo_t * topo, int placement,
+                          unsigned int n_workers, int * cpus) {
+    unsigned int n = 0;
+
+    if (placement == TEST_PIN_NONE)
+        return NULL;
+    if (placement == TEST_PIN_CORES) {
+        /* round-robin over nodes, taking the next primary thread of each */
+        for (unsigned int round = 0; n < n_workers && round < topo->n_cores; ++round) {
+            for (unsigned int node = 0; node < topo->n_nodes && n < n_workers; ++node) {
+                unsigned int seen = 0;
+                for (unsigned int core = 0; core < topo->n_cores; ++core) {
+                    if (topo->cpu_node[topo->core_cpu[core]] != (int) node)
+                        continue ;
+                    if (seen++ == round) {
+                        cpus[n++] = topo->cpu_id[topo->core_cpu[core]];
+                        break ;
+                    }
+                }
+            }
+        }
+    } else {
+        /* node by node, core by core, every smt thread of each core */
+        for (unsigned int node = 0; node < topo->n_nodes && n < n_workers; ++node) {
+            for (unsigned int core = 0; core < topo->n_cores && n < n_workers; ++core) {
+                for (unsigned int i = 0; i < topo->n_cpus && n < n_workers; ++i) {
+                    if (topo->cpu_core[i] == (int) core && topo->cpu_node[i] == (int) node)
+                        cpus[n++] = topo->cpu_id[i];
+                }
+            }
+        }
+    }
+    /* more workers than places: wrap around */
+    for (unsigned int i = n; n > 0 && i < n_workers; ++i)
+        cpus[i] = cpus[i % n];
+    return n > 0 ? cpus : NULL;
+}
+
 /* test vsersion string */
 const char * test_version_string() {
     static const char * ver_str = VERSION_STRING;
     return ver_str;
 }
 
-/** for parallel tests */
+/** for parallel tests: completion of test jobs is signaled to the dispatcher */
 typedef struct {
-    vjob_t *        job;
-    unsigned int    testidx;
+    pthread_mutex_t     lock;
+    pthread_cond_t      cond;
+    unsigned int        n_done;     /* finished jobs not yet collected */
+} testjob_notify_t;
+
+typedef struct {
+    vjob_t *            job;
+    unsigned int        testidx;
+    options_test_t *    opts;
+    testjob_notify_t *  notify;
+    int                 done;       /* protected by notify->lock, 2 if found by polling */
 } testjob_t;
 
+/* runs the test, then wakes up check_test_jobs() */
+static void * test_job_trampoline(void * vdata) {
+    testjob_t *         tjob = (testjob_t *) vdata;
+    testjob_notify_t *  notify = tjob->notify;
+    void *              result;
+
+    result = s_testconfig[tjob->testidx].fun(tjob->opts);
+
+    pthread_mutex_lock(&notify->lock);
+    tjob->done = 1;
+    ++(notify->n_done);
+    pthread_cond_signal(&notify->cond);
+    pthread_mutex_unlock(&notify->lock);
+
+    return result;
+}
+
 unsigned long check_test_jobs(options_test_t * opts, log_t * log, shlist_t * jobs,
                               unsigned int * nb_jobs, unsigned long * current_tests) {
     unsigned long nerrors = 0;
     testjob_t * tjob;
+    testjob_notify_t * notify;
     unsigned int nb_jobs_orig = *nb_jobs;
     (void) opts;
 
@@ -278,28 +515,37 @@ unsigned long check_test_jobs(options_test_t * opts, log_t * log, shlist_t * job
     }
 
     tjob = (testjob_t *) jobs->head->data;
+    notify = tjob->notify;
 
     LOG_INFO(log, "WAITING for 1 termination (%u running)", *nb_jobs);
 
     while (nb_jobs_orig == *nb_jobs) {
+        slist_t *   finished = NULL, * finished_tail = NULL;
+        int         timedout = 0;
+
+        pthread_mutex_lock(&notify->lock);
+        while (notify->n_done == 0 && !timedout) {
+            struct timespec ts;
+            clock_gettime(CLOCK_REALTIME, &ts);
+            ts.tv_sec += 5;
+            if (pthread_cond_timedwait(&notify->cond, &notify->lock, &ts) == ETIMEDOUT) {
+                /* jobs cancelled or exited without returning never signal: poll them */
+                SLIST_FOREACH_DATA(jobs->head, it_tjob, testjob_t *) {
+                    if (!it_tjob->done && vjob_done(it_tjob->job)) {
+                        it_tjob->done = 2;
+                        ++(notify->n_done);
+                    }
+                }
+                timedout = 1;
+            }
+        }
+        /* under the lock, only move finished jobs to their own list */
         for (slist_t * list = jobs->head, * prev = NULL; list != NULL; /*no_incr*/) {
             tjob = (testjob_t *) (list->data);
-            vjob_t * vjob = tjob->job;
-            if (vjob_done(vjob)) {
-                slist_t *   to_free = list;
-                void *      result = vjob_free(vjob);
-
-                if (result == VJOB_ERR_RESULT || result == VJOB_NO_RESULT) {
-                    LOG_ERROR(log, "error: cannot get job result for '%s'",
-                            s_testconfig[tjob->testidx].name);
-                    ++nerrors;
-                } else {
-                    LOG_VERBOSE(log, "TEST JOB '%s' finished with result %ld",
-                                s_testconfig[tjob->testidx].name, (long) result);
-                    nerrors += (long) result;
-                }
-                --(*nb_jobs);
-                *current_tests &= ~TEST_MASK(tjob->testidx);
+            if (tjob->done) {
+                slist_t *   to_move = list;
+
+                --(notify->n_done);
                 if (list == jobs->tail) {
                     jobs->tail = prev;
                 }
@@ -309,13 +555,46 @@ unsigned long check_test_jobs(options_test_t * opts, log_t * log, shlist_t * job
                 } else {
                     prev->next = list;
                 }
-                slist_free_1(to_free, free);
+                to_move->next = NULL;
+                if (finished_tail == NULL) {
+                    finished = to_move;
+                } else {
+                    finished_tail->next = to_move;
+                }
+                finished_tail = to_move;
             } else {
                 prev = list;
                 list = list->next;
             }
         }
-        usleep(100000);
+        pthread_mutex_unlock(&notify->lock);
+
+        if (finished == NULL) {
+            LOG_VERBOSE(log, "still WAITING for 1 termination (%u running)", *nb_jobs);
+            continue ;
+        }
+        /* join and log them without the lock: jobs are returning, or already gone */
+        SLIST_FOREACH_DATA(finished, it_tjob, testjob_t *) {
+            void * result;
+
+            if (it_tjob->done == 2) {
+                LOG_VERBOSE(log, "TEST JOB '%s' ended without notification",
+                            s_testconfig[it_tjob->testidx].name);
+            }
+            result = vjob_waitandfree(it_tjob->job);
+            if (result == VJOB_ERR_RESULT || result == VJOB_NO_RESULT) {
+                LOG_ERROR(log, "error: cannot get job result for '%s'",
+                        s_testconfig[it_tjob->testidx].name);
+                ++nerrors;
+            } else {
+                LOG_VERBOSE(log, "TEST JOB '%s' finished with result %ld",
+                            s_testconfig[it_tjob->testidx].name, (long) result);
+                nerrors += (long) result;
+            }
+            --(*nb_jobs);
+            *current_tests &= ~TEST_MASK(it_tjob->testidx);
+        }
+        slist_free(finished, free);
     }
     return nerrors;
 }
@@ -338,6 +617,8 @@ int test(int argc, const char *const* argv, unsigned long test_mode, logpool_t *
     sigset_t        sigset_bak;
     unsigned int    nb_jobs = 0;
     unsigned long   current_tests = 0;
+    testjob_notify_t notify = { .lock = PTHREAD_MUTEX_INITIALIZER,
+                                .cond = PTHREAD_COND_INITIALIZER, .n_done = 0 };
 
     LOG_INFO(log, NULL);
     if ((tmpdir = test_tmpdir()) == NULL) {
@@ -420,14 +701,17 @@ int test(int argc, const char *const* argv, unsigned long test_mode, logpool_t *
                 } while (jobs.head != NULL);
 
                 LOG_VERBOSE(log, "RUNNING test job '%s'...", s_testconfig[testidx].name);
-                if ((tjob = malloc(sizeof(*tjob))) == NULL
-                || (tjob->job = vjob_run(s_testconfig[testidx].fun, &options_test)) == NULL) {
+                if ((tjob = malloc(sizeof(*tjob))) != NULL) {
+                    *tjob = (testjob_t) { .testidx = testidx, .opts = &options_test,
+                                          .notify = &notify, .done = 0 };
+                }
+                if (tjob == NULL
+                || (tjob->job = vjob_run(test_job_trampoline, tjob)) == NULL) {
                     if (tjob != NULL)
                         free(tjob);
                     LOG_ERROR(log, "error: cannot run job for test '%s'", s_testconfig[testidx].name);
                     ++errors;
                 } else {
-                    tjob->testidx = testidx;
                     current_tests |= TEST_MASK(testidx);
                     ++nb_jobs;
                     if ((jobs.head = slist_appendto(jobs.head, tjob, &jobs.tail)) != NULL
@@ -455,6 +739,8 @@ int test(int argc, const char *const* argv, unsigned long test_mode, logpool_t *
     }
     BENCHS_STOP(bench, cpu_bench);
     slist_free(jobs.head, free);
+    pthread_cond_destroy(&(notify.cond));
+    pthread_mutex_destroy(&(notify.lock));
 
     if ((test_mode & TEST_MASK(TEST_PARALLEL)) != 0
     &&  sigprocmask(SIG_SETMASK, &sigset_bak, NULL) != 0) {
@@ -103,12 +103,35 @@ enum testmode_t {
     TEST_optusage_stdout,
     TEST_logpool_big,
     TEST_bighash,
+    TEST_bigrbuf,
+    TEST_biglist,
+    TEST_bigjob,
     TEST_PARALLEL,
     TEST_NB /* Must be LAST ! */
 };
 #define TEST_MASK(id)       (1UL << ((unsigned int) (id)))
 #define TEST_MASK_ALL       (~(0UL))
 
+/* cpu topology from /sys (linux): online cpus, physical core and numa node of each.
+ * Elsewhere, or if /sys is not readable, each cpu is a core of node 0. */
+typedef struct {
+    unsigned int            n_cpus;
+    unsigned int            n_cores;
+    unsigned int            n_nodes;
+    int *                   cpu_id;         /* id of each online cpu */
+    int *                   cpu_core;       /* core index of each online cpu */
+    int *                   cpu_node;       /* numa node of each online cpu */
+    int *                   core_cpu;       /* first online cpu (smt thread) of each core */
+} test_topo_t;
+
+/* placement of pinned test workers */
+enum {
+    TEST_PIN_NONE = 0,      /* let the scheduler migrate workers */
+    TEST_PIN_CORES,         /* one worker per physical core, spread over nodes */
+    TEST_PIN_COMPACT,       /* smt siblings first, then next core of the same node */
+    TEST_PIN_NB
+};
+
 /* ********************************************************************/
 # ifdef __cplusplus
 extern "C" {
@@ -121,6 +144,15 @@ int             intcmp(const void * a, const void *b);
 const char *    test_tmpdir();
 int             test_clean_tmpdir();
 
+/* returns 0 if topology was read from /sys, 1 if defaulted, -1 on error */
+int             test_topo_get(test_topo_t * topo);
+void            test_topo_free(test_topo_t * topo);
+/* fills cpus[n_workers] with cpu ids, returns NULL for TEST_PIN_NONE or on error */
+int *           test_topo_placement(const test_topo_t * topo, int placement,
+                                    unsigned int n_workers, int * cpus);
+/* pins the calling thread on one cpu, returns 0 or -1 */
+int             test_cpu_pin(int cpu);
+
 # ifdef __cplusplus
 }
 # endif